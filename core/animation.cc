@@ -78,6 +78,38 @@ void rigid_animation::apply(transformable& node, time_ticks time) const
         node.set_orientation(normalize(orientation[time]));
 }
 
+void rigid_animation::apply(transformable& node, time_ticks time, cursor& c) const
+{
+    vec3 p, s;
+    quat o;
+    sample(time, c, p, s, o);
+    if(position.size())
+        node.set_position(p);
+    if(scaling.size())
+        node.set_scaling(s);
+    if(orientation.size())
+        node.set_orientation(o);
+}
+
+void rigid_animation::sample(
+    time_ticks time,
+    cursor& c,
+    vec3& position,
+    vec3& scaling,
+    quat& orientation
+) const
+{
+    if(this->position.size())
+        this->position.get(time, position, c.position);
+    if(this->scaling.size())
+        this->scaling.get(time, scaling, c.scaling);
+    if(this->orientation.size())
+    {
+        this->orientation.get(time, orientation, c.orientation);
+        orientation = normalize(orientation);
+    }
+}
+
 time_ticks rigid_animation::get_loop_time() const
 {
     time_ticks loop_time = 0;
@@ -90,6 +122,25 @@ time_ticks rigid_animation::get_loop_time() const
     return loop_time;
 }
 
+void sample_rigid_animations(
+    time_ticks time,
+    argvec<const rigid_animation*> animations,
+    rigid_animation::cursor* cursors,
+    vec3* positions,
+    vec3* scalings,
+    quat* orientations
+){
+    for(size_t i = 0; i < animations.size(); ++i)
+    {
+        if(animations[i])
+        {
+            animations[i]->sample(
+                time, cursors[i], positions[i], scalings[i], orientations[i]
+            );
+        }
+    }
+}
+
 rigid_animated::rigid_animated(const rigid_animation_pool* pool)
 : pool(pool), cur_anim(nullptr)
 {
@@ -110,6 +161,7 @@ time_ticks rigid_animated::set_animation(const std::string& name)
         if(it != pool->end())
         {
             cur_anim = &it->second;
+            cur_anim_cursor = {};
             loop_time = max(loop_time, cur_anim->get_loop_time());
         }
     }
@@ -138,7 +190,7 @@ void update_rigid_animations(scene& ctx, time_ticks delta)
         a.update(delta);
         if(a.is_playing())
         {
-            if(a.cur_anim) a.cur_anim->apply(t, a.get_animation_time());
+            if(a.cur_anim) a.cur_anim->apply(t, a.get_animation_time(), a.cur_anim_cursor);
         }
     });
 }
@@ -3,6 +3,7 @@
 #include "transformable.hh"
 #include "ecs.hh"
 #include "types.hh"
+#include "argvec.hh"
 #include <vector>
 #include <unordered_map>
 
@@ -97,6 +98,23 @@ enum interpolation
     SMOOTHSTEP
 };
 
+// Remembers where the previous interpolation happened in the samples. When
+// time moves forward between calls, the next samples are found by stepping
+// from there instead of a binary search over all samples.
+struct animation_cursor
+{
+    size_t index = 0;
+};
+
+// Returns the index of the first sample after 'time', or data.size() if there
+// is none. 'hint' is the previous result, if known.
+template<typename T>
+size_t find_next_sample(
+    time_ticks time,
+    const std::vector<animation_sample<T>>& data,
+    size_t hint = 0
+);
+
 template<typename T>
 void interpolate(
     time_ticks time,
@@ -105,6 +123,15 @@ void interpolate(
     interpolation interp
 );
 
+template<typename T>
+void interpolate(
+    time_ticks time,
+    const std::vector<animation_sample<T>>& data,
+    T& output,
+    interpolation interp,
+    animation_cursor& cursor
+);
+
 template<typename T>
 class variable_animation
 {
@@ -116,6 +143,7 @@ public:
 
     T operator[](time_ticks time) const;
     void get(time_ticks time, T& into) const;
+    void get(time_ticks time, T& into, animation_cursor& cursor) const;
     time_ticks get_loop_time() const;
     size_t size() const;
 
@@ -127,6 +155,14 @@ private:
 class rigid_animation
 {
 public:
+    // Per-user playback state, see animation_cursor.
+    struct cursor
+    {
+        animation_cursor position;
+        animation_cursor scaling;
+        animation_cursor orientation;
+    };
+
     rigid_animation();
 
     void set_position(
@@ -150,6 +186,16 @@ public:
     );
 
     void apply(transformable& node, time_ticks time) const;
+    void apply(transformable& node, time_ticks time, cursor& c) const;
+
+    // Missing channels leave their output untouched.
+    void sample(
+        time_ticks time,
+        cursor& c,
+        vec3& position,
+        vec3& scaling,
+        quat& orientation
+    ) const;
     time_ticks get_loop_time() const;
 
 private:
@@ -163,6 +209,18 @@ using rigid_animation_pool = std::unordered_map<
     rigid_animation
 >;
 
+// Samples many rigid animations at the same time into separate position,
+// scaling and orientation arrays, e.g. all joints of a skeleton. Null
+// animations and missing channels leave their outputs untouched.
+void sample_rigid_animations(
+    time_ticks time,
+    argvec<const rigid_animation*> animations,
+    rigid_animation::cursor* cursors,
+    vec3* positions,
+    vec3* scalings,
+    quat* orientations
+);
+
 // You can use this to provide the animation functions to your class, as long as
 // you implement the following member functions:
 //   time_ticks set_animation(const std::string& name);
@@ -191,6 +249,15 @@ public:
     time_ticks get_animation_time() const;
     size_t get_animation_state_hash() const;
 
+    // The animation time advances on every update(), but the animation is
+    // only applied on every 'interval'th one. Different 'phase' values spread
+    // the applications of same-interval controllers over different updates.
+    // An interval of 1 applies on every update, which is the default. Only
+    // steady playback is throttled: starting, switching and ending
+    // animations is always applied on the next update.
+    void set_update_interval(uint32_t interval, uint32_t phase = 0);
+    uint32_t get_update_interval() const;
+
     void update(time_ticks dt);
 
 private:
@@ -203,8 +270,16 @@ private:
     };
     std::vector<animation_step> animation_queue;
     time_ticks timer;
+    // The timer at the latest apply_animation().
+    time_ticks applied_timer;
     time_ticks loop_time;
     bool paused;
+    // Set when the animation changed, so that the next update() applies it
+    // regardless of the update interval.
+    bool apply_pending;
+    uint32_t update_interval;
+    uint32_t update_phase;
+    uint32_t update_counter;
 };
 
 class animation_updater;
@@ -217,6 +292,7 @@ public:
 
     const rigid_animation_pool* pool;
     const rigid_animation* cur_anim;
+    rigid_animation::cursor cur_anim_cursor;
 
 protected:
     time_ticks set_animation(const std::string& name);
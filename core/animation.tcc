@@ -43,18 +43,55 @@ void interpolate_cubic_spline(
 }
 
 template<typename T>
-void interpolate(
+size_t find_next_sample(
     time_ticks time,
     const std::vector<animation_sample<T>>& data,
-    T& output,
-    interpolation interp
+    size_t hint
 ){
+    auto begin = data.begin();
+    if(hint <= data.size() && (hint == 0 || data[hint-1].timestamp <= time))
+    {
+        // Playback is usually monotonic, so the sample is most likely at or
+        // right after the hint. Only check a few, the rest are binary searched.
+        size_t end = std::min(hint + 4, data.size());
+        for(; hint < end; ++hint)
+        {
+            if(time < data[hint].timestamp)
+                return hint;
+        }
+        begin += hint;
+    }
+
     auto it = std::upper_bound(
-        data.begin(), data.end(), time,
+        begin, data.end(), time,
         [](time_ticks time, const animation_sample<T>& s){
             return time < s.timestamp;
         }
     );
+    return it - data.begin();
+}
+
+template<typename T>
+void interpolate(
+    time_ticks time,
+    const std::vector<animation_sample<T>>& data,
+    T& output,
+    interpolation interp
+){
+    animation_cursor cursor;
+    interpolate(time, data, output, interp, cursor);
+}
+
+template<typename T>
+void interpolate(
+    time_ticks time,
+    const std::vector<animation_sample<T>>& data,
+    T& output,
+    interpolation interp,
+    animation_cursor& cursor
+){
+    cursor.index = find_next_sample(time, data, cursor.index);
+    auto it = data.begin() + cursor.index;
     if(it == data.end())
     {
         output = data.back().data;
@@ -112,6 +149,12 @@ void variable_animation<T>::get(time_ticks time, T& into) const
    interpolate<T>(time, samples, into, interp);
 }
 
+template<typename T>
+void variable_animation<T>::get(time_ticks time, T& into, animation_cursor& cursor) const
+{
+   interpolate<T>(time, samples, into, interp, cursor);
+}
+
 template<typename T>
 time_ticks variable_animation<T>::get_loop_time() const
 {
@@ -126,7 +169,8 @@ size_t variable_animation<T>::size() const
 
 template<typename Derived>
 animation_controller<Derived>::animation_controller()
-: timer(0), loop_time(0), paused(false)
+:   timer(0), applied_timer(0), loop_time(0), paused(false), apply_pending(false),
+    update_interval(1), update_phase(0), update_counter(0)
 {
 }
 
@@ -139,6 +183,7 @@ animation_controller<Derived>& animation_controller<Derived>::queue(
     {
         timer = 0;
         loop_time = static_cast<Derived*>(this)->set_animation(name);
+        apply_pending = true;
     }
     return *this;
 }
@@ -150,6 +195,7 @@ void animation_controller<Derived>::play(const std::string& name, bool loop)
     animation_queue.emplace_back(name, loop);
     timer = 0;
     loop_time = static_cast<Derived*>(this)->set_animation(name);
+    apply_pending = true;
 }
 
 template<typename Derived>
@@ -185,7 +231,9 @@ void animation_controller<Derived>::stop()
 {
     animation_queue.clear();
     timer = 0;
+    applied_timer = 0;
     loop_time = 0;
+    apply_pending = false;
 }
 
 template<typename Derived>
@@ -207,10 +255,23 @@ template<typename Derived>
 size_t animation_controller<Derived>::get_animation_state_hash() const
 {
     size_t seed = animation_queue.empty() ? 0 : animation_queue.front().name_hash;
-    hash_combine(seed, timer);
+    hash_combine(seed, applied_timer);
     return seed;
 }
 
+template<typename Derived>
+void animation_controller<Derived>::set_update_interval(uint32_t interval, uint32_t phase)
+{
+    update_interval = max(interval, 1u);
+    update_phase = phase;
+}
+
+template<typename Derived>
+uint32_t animation_controller<Derived>::get_update_interval() const
+{
+    return update_interval;
+}
+
 template<typename Derived>
 void animation_controller<Derived>::update(time_ticks dt)
 {
@@ -231,6 +292,7 @@ void animation_controller<Derived>::update(time_ticks dt)
             loop_time = static_cast<Derived*>(this)->set_animation(
                 animation_queue.front().name
             );
+            apply_pending = true;
         }
     }
     // If there's nothing waiting, then keep looping.
@@ -242,13 +304,26 @@ void animation_controller<Derived>::update(time_ticks dt)
     // If we're past the end of a non-looping animation, stop animating.
     else if(timer >= loop_time)
     {
+        // Throttling may have skipped the latest poses, so the one an
+        // unthrottled controller would have ended on is applied here.
+        time_ticks end_time = timer - dt;
+        if(applied_timer != end_time || apply_pending)
+            static_cast<Derived*>(this)->apply_animation(end_time);
         animation_queue.erase(animation_queue.begin());
         loop_time = 0;
         timer = 0;
+        applied_timer = 0;
+        apply_pending = false;
         return;
     }
 
-    static_cast<Derived*>(this)->apply_animation(timer);
+    bool scheduled = (update_counter++ + update_phase) % update_interval == 0;
+    if(scheduled || apply_pending)
+    {
+        applied_timer = timer;
+        apply_pending = false;
+        static_cast<Derived*>(this)->apply_animation(timer);
+    }
 }
 
 template<typename Derived>
@@ -2,6 +2,113 @@
 #include "error.hh"
 #include <stdexcept>
 #include <cstring>
+#include <algorithm>
+#include <string_view>
+#if __has_include(<sys/mman.h>)
+#define RAYBASE_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef RAYBASE_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+using namespace rb;
+
+struct archive_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t names_size;
+};
+
+constexpr char archive_magic[4] = {'R', 'B', 'P', 'K'};
+constexpr uint32_t archive_version = 1;
+constexpr uint64_t archive_alignment = 4096;
+
+void map_native_file(
+    const fs::path& path, const uint8_t*& data, size_t& size,
+    bool sequential = true
+){
+    size = 0;
+    data = nullptr;
+
+#ifdef RAYBASE_USE_MMAP
+    // Mapping the file lets parsers start on it right away, and the pages can
+    // be dropped by the OS instead of being copied into a heap buffer.
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        RB_PANIC("Unable to read file ", path.string());
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        RB_PANIC("Unable to read file ", path.string());
+    }
+
+    size = st.st_size;
+    if(size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED)
+    {
+        size = 0;
+        RB_PANIC("Unable to map file ", path.string());
+    }
+
+    // Files are nearly always parsed front to back in one go.
+    if(sequential)
+    {
+        madvise(ptr, size, MADV_SEQUENTIAL);
+        madvise(ptr, size, MADV_WILLNEED);
+    }
+    data = (const uint8_t*)ptr;
+#else
+    (void)sequential;
+    std::ifstream i(path, std::ifstream::binary);
+    i.imbue(std::locale::classic());
+    if(!i.is_open())
+        RB_PANIC("Unable to read file ", path.string());
+
+    i.seekg(0, i.end);
+    size = i.tellg();
+    i.seekg(0, i.beg);
+
+    uint8_t* buf = new uint8_t[size];
+
+    if(!i.read((char*)buf, size))
+    {
+        delete [] buf;
+        RB_PANIC("Read failure! ", path.string());
+    }
+
+    data = buf;
+#endif
+}
+
+void unmap_native_file(const uint8_t* data, size_t size)
+{
+#ifdef RAYBASE_USE_MMAP
+    if(data)
+        munmap((void*)data, size);
+#else
+    (void)size;
+    delete [] data;
+#endif
+}
+
+}
 
 namespace rb
 {
@@ -104,6 +211,11 @@ file& file::operator=(const file& other)
     return *this;
 }
 
+uint64_t filesystem::get_modification_time(const std::string&) const
+{
+    return 0;
+}
+
 file filesystem::get(const std::string& name)
 {
     std::unique_lock lk(ref_lock);
@@ -156,36 +268,241 @@ bool native_filesystem::exists(const std::string& name) const
     return fs::exists(root/name);
 }
 
+uint64_t native_filesystem::get_modification_time(const std::string& name) const
+{
+    std::error_code err;
+    fs::file_time_type time = fs::last_write_time(root/name, err);
+    if(err) return 0;
+    return time.time_since_epoch().count();
+}
+
 void native_filesystem::map(
     const std::string& name, const uint8_t*& data, size_t& size
 ){
-    size = 0;
+    map_native_file(root/name, data, size);
+}
+
+void native_filesystem::unmap(const std::string&, const uint8_t* data, size_t size)
+{
+    unmap_native_file(data, size);
+}
+
+struct archive_filesystem::entry
+{
+    uint64_t offset;
+    // Size of the file when mapped.
+    uint64_t size;
+    // Size of the data in the archive, differs from 'size' when compressed.
+    uint64_t stored_size;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t compression;
+    uint32_t padding;
+};
+
+archive_filesystem::archive_filesystem(const fs::path& archive_path)
+: archive_path(archive_path)
+{
+    // Entries are looked up in whatever order the resources are requested,
+    // so the archive isn't mapped for sequential access. Each entry gets its
+    // own readahead hint in map() instead.
+    map_native_file(archive_path, archive_data, archive_size, false);
+
+    RB_CHECK(
+        archive_size < sizeof(archive_header),
+        "Not an archive: ", archive_path.string()
+    );
+    const archive_header* header = (const archive_header*)archive_data;
+    RB_CHECK(
+        memcmp(header->magic, archive_magic, sizeof(header->magic)) != 0 ||
+        header->version != archive_version,
+        "Unsupported archive: ", archive_path.string()
+    );
+
+    entry_count = header->entry_count;
+    size_t toc_size = sizeof(archive_header) + entry_count * sizeof(entry) +
+        header->names_size;
+    RB_CHECK(
+        toc_size > archive_size,
+        "Truncated archive: ", archive_path.string()
+    );
+    entries = (const entry*)(archive_data + sizeof(archive_header));
+    names = (const char*)(entries + entry_count);
+
+    for(uint32_t i = 0; i < entry_count; ++i)
+    {
+        const entry& e = entries[i];
+        // Written so that corrupt offsets and sizes can't overflow.
+        RB_CHECK(
+            e.offset > archive_size ||
+            e.stored_size > archive_size - e.offset ||
+            uint64_t(e.name_offset) + e.name_length > header->names_size,
+            "Corrupt archive entry in ", archive_path.string()
+        );
+    }
+}
+
+archive_filesystem::~archive_filesystem()
+{
+    unmap_native_file(archive_data, archive_size);
+}
+
+bool archive_filesystem::exists(const std::string& name) const
+{
+    return find(name) != nullptr;
+}
+
+void archive_filesystem::pack(
+    const fs::path& archive_path,
+    filesystem& source,
+    const std::vector<std::string>& file_names,
+    compression method
+){
+#ifndef RAYBASE_HAS_ZSTD
+    (void)method;
+#endif
+    // The table of contents must be sorted for binary search.
+    std::vector<std::string> sorted_names = file_names;
+    std::sort(sorted_names.begin(), sorted_names.end());
+    sorted_names.erase(
+        std::unique(sorted_names.begin(), sorted_names.end()),
+        sorted_names.end()
+    );
+
+    std::vector<entry> toc(sorted_names.size());
+    std::string name_table;
+    for(size_t i = 0; i < sorted_names.size(); ++i)
+    {
+        toc[i].name_offset = name_table.size();
+        toc[i].name_length = sorted_names[i].size();
+        name_table += sorted_names[i];
+    }
+
+    archive_header header;
+    memcpy(header.magic, archive_magic, sizeof(header.magic));
+    header.version = archive_version;
+    header.entry_count = toc.size();
+    header.names_size = name_table.size();
+
+    std::ofstream o(archive_path, std::ofstream::binary);
+    if(!o.is_open())
+        RB_PANIC("Unable to write file ", archive_path.string());
+
+    uint64_t offset = sizeof(archive_header) + toc.size() * sizeof(entry) +
+        name_table.size();
+#ifdef RAYBASE_HAS_ZSTD
+    std::vector<uint8_t> compressed;
+#endif
+    for(size_t i = 0; i < sorted_names.size(); ++i)
+    {
+        file f = source.get(sorted_names[i]);
+        const uint8_t* data = f.get_data();
+        entry& e = toc[i];
+        e.size = f.get_size();
+        e.stored_size = e.size;
+        e.compression = NONE;
+        e.padding = 0;
+
+#ifdef RAYBASE_HAS_ZSTD
+        if(method == ZSTD && e.size > 0)
+        {
+            compressed.resize(ZSTD_compressBound(e.size));
+            size_t compressed_size = ZSTD_compress(
+                compressed.data(), compressed.size(), data, e.size, 19
+            );
+            if(!ZSTD_isError(compressed_size) && compressed_size < e.size)
+            {
+                data = compressed.data();
+                e.stored_size = compressed_size;
+                e.compression = ZSTD;
+            }
+        }
+#endif
+
+        // Uncompressed entries are page-aligned so that they can be used
+        // straight from the mapping. Compressed ones are copied anyway, so
+        // they're packed tightly.
+        if(e.compression == NONE)
+            offset = (offset + archive_alignment - 1) / archive_alignment * archive_alignment;
+        e.offset = offset;
+        o.seekp(offset);
+        o.write((const char*)data, e.stored_size);
+        offset += e.stored_size;
+    }
+
+    o.seekp(0);
+    o.write((const char*)&header, sizeof(header));
+    o.write((const char*)toc.data(), toc.size() * sizeof(entry));
+    o.write(name_table.data(), name_table.size());
+    if(!o)
+        RB_PANIC("Write failure! ", archive_path.string());
+}
+
+void archive_filesystem::map(
+    const std::string& name, const uint8_t*& data, size_t& size
+){
     data = nullptr;
+    size = 0;
 
-    fs::path path = root/name;
-    std::ifstream i(path, std::ifstream::binary);
-    i.imbue(std::locale::classic());
-    if(!i.is_open())
-        RB_PANIC("Unable to read file ", path.string());
+    const entry* e = find(name);
+    if(!e)
+        RB_PANIC("Unable to read file ", name, " from ", archive_path.string());
 
-    i.seekg(0, i.end);
-    size = i.tellg();
-    i.seekg(0, i.beg);
+    size = e->size;
+    if(size == 0)
+        return;
 
-    uint8_t* buf = new uint8_t[size];
+    if(e->compression == NONE)
+    {
+        data = archive_data + e->offset;
+#ifdef RAYBASE_USE_MMAP
+        madvise((void*)data, size, MADV_WILLNEED);
+#endif
+        return;
+    }
 
-    if(!i.read((char*)buf, size))
+#ifdef RAYBASE_HAS_ZSTD
+    if(e->compression == ZSTD)
     {
-        delete [] buf;
-        RB_PANIC("Read failure! ", path.string());
+        uint8_t* buf = new uint8_t[size];
+        size_t result = ZSTD_decompress(
+            buf, size, archive_data + e->offset, e->stored_size
+        );
+        if(ZSTD_isError(result) || result != size)
+        {
+            delete [] buf;
+            size = 0;
+            RB_PANIC("Decompression failure! ", name);
+        }
+        data = buf;
+        return;
     }
+#endif
+    size = 0;
+    RB_PANIC("Unsupported compression for ", name, " in ", archive_path.string());
+}
 
-    data = buf;
+void archive_filesystem::unmap(const std::string& name, const uint8_t* data, size_t)
+{
+    const entry* e = find(name);
+    if(e && e->compression != NONE)
+        delete [] data;
 }
 
-void native_filesystem::unmap(const std::string&, const uint8_t* data, size_t)
+const archive_filesystem::entry* archive_filesystem::find(
+    const std::string& name
+) const
 {
-    delete [] data;
+    const entry* end = entries + entry_count;
+    const entry* it = std::lower_bound(
+        entries, end, std::string_view(name),
+        [&](const entry& e, std::string_view name){
+            return std::string_view(names + e.name_offset, e.name_length) < name;
+        }
+    );
+    if(it == end || std::string_view(names + it->name_offset, it->name_length) != name)
+        return nullptr;
+    return it;
 }
 
 }
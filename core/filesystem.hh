@@ -6,6 +6,7 @@
 #include <fstream>
 #include <mutex>
 #include <filesystem>
+#include <vector>
 namespace fs = std::filesystem;
 
 namespace rb
@@ -64,6 +65,9 @@ public:
     virtual ~filesystem() = default;
 
     virtual bool exists(const std::string& name) const = 0;
+    // Returns an opaque timestamp that changes whenever the file is modified,
+    // or zero if the filesystem doesn't track modification times.
+    virtual uint64_t get_modification_time(const std::string& name) const;
     file get(const std::string& name);
     file operator[](const std::string& name);
 
@@ -97,6 +101,7 @@ public:
     native_filesystem(const fs::path& root);
 
     bool exists(const std::string& name) const override;
+    uint64_t get_modification_time(const std::string& name) const override;
 
 protected:
     void map(
@@ -111,6 +116,55 @@ private:
     fs::path root;
 };
 
+// Serves files from a single packed archive, so that a level load only needs
+// to open and map one file. Uncompressed entries are page-aligned and handed
+// out directly from the mapping; compressed entries are decompressed on
+// map(). Archives are created with archive_filesystem::pack().
+class archive_filesystem: public filesystem
+{
+public:
+    enum compression: uint32_t
+    {
+        NONE = 0,
+        ZSTD = 1
+    };
+
+    archive_filesystem(const fs::path& archive_path);
+    ~archive_filesystem();
+
+    bool exists(const std::string& name) const override;
+
+    // Writes all given files from 'source' into a new archive. Files are only
+    // stored compressed if compression is available and it actually makes
+    // them smaller.
+    static void pack(
+        const fs::path& archive_path,
+        filesystem& source,
+        const std::vector<std::string>& names,
+        compression method = NONE
+    );
+
+protected:
+    void map(
+        const std::string& name, const uint8_t*& data, size_t& size
+    ) override;
+
+    void unmap(
+        const std::string& name, const uint8_t* data, size_t size
+    ) override;
+
+private:
+    struct entry;
+    const entry* find(const std::string& name) const;
+
+    fs::path archive_path;
+    const uint8_t* archive_data;
+    size_t archive_size;
+    const entry* entries;
+    uint32_t entry_count;
+    const char* names;
+};
+
 }
 
 #endif
@@ -27,6 +27,21 @@ void write_binary_file(
     fclose(f);
 }
 
+bool try_write_binary_file(
+    const std::string& path,
+    const uint8_t* data,
+    size_t size
+){
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f) return false;
+
+    bool ok = fwrite(data, 1, size, f) == size;
+    // Buffered data is only written out here, so a full disk may fail late.
+    ok = fclose(f) == 0 && ok;
+    if(!ok) remove(path.c_str());
+    return ok;
+}
+
 void write_text_file(const std::string& path, const std::string& content)
 {
     write_binary_file(path, (uint8_t*)content.c_str(), content.size());
@@ -57,6 +72,17 @@ std::string read_text_file(const std::string& path)
     return ret;
 }
 
+uint64_t hash_data(const uint8_t* data, size_t size, uint64_t seed)
+{
+    uint64_t hash = seed;
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 #ifdef RAYBASE_HAS_SDL2
 fs::path get_writable_path()
 {
@@ -10,6 +10,8 @@ namespace rb
 {
 
 void write_binary_file(const std::string& path, const uint8_t* data, size_t size);
+// Returns false instead of panicking if the file can't be written.
+bool try_write_binary_file(const std::string& path, const uint8_t* data, size_t size);
 void write_text_file(const std::string& path, const std::string& content);
 
 #if RAYBASE_BIG_ENDIAN
@@ -31,6 +33,15 @@ inline std::string to_string(const fs::path& p) { return p.string(); }
 
 std::string read_text_file(const std::string& path);
 
+// 64-bit FNV-1a, stable across platforms and runs. Use it for keying caches
+// of derived data by their source files. Pass a previous result as 'seed' to
+// hash multiple blocks of data as if they were one.
+uint64_t hash_data(
+    const uint8_t* data,
+    size_t size,
+    uint64_t seed = 0xcbf29ce484222325ull
+);
+
 #ifdef RAYBASE_HAS_SDL2
 fs::path get_writable_path();
 std::vector<fs::path> get_readonly_paths();
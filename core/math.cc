@@ -1,6 +1,7 @@
 #include "math.hh"
 #include "sort.hh"
 #include <sstream>
+#include <xmmintrin.h>
 
 namespace
 {
@@ -580,6 +581,55 @@ bool aabb_frustum_cull(const aabb& box, const struct frustum& f)
     return true;
 }
 
+void aabb_frustum_cull_batch(
+    const aabb* boxes,
+    size_t count,
+    const struct frustum& f,
+    bool* visible
+){
+    // The box is fully outside of a plane if its corner furthest along the
+    // plane normal is outside. Per axis, that corner is found with a max()
+    // instead of testing all eight corners.
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const aabb* b = boxes + i;
+        __m128 min_x = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+        __m128 min_y = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+        __m128 min_z = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+        __m128 max_x = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+        __m128 max_y = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+        __m128 max_z = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+
+        __m128 outside = zero;
+        for(const vec4& p: f.planes)
+        {
+            __m128 px = _mm_set1_ps(p.x);
+            __m128 py = _mm_set1_ps(p.y);
+            __m128 pz = _mm_set1_ps(p.z);
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_max_ps(_mm_mul_ps(px, min_x), _mm_mul_ps(px, max_x)),
+                    _mm_max_ps(_mm_mul_ps(py, min_y), _mm_mul_ps(py, max_y))
+                ),
+                _mm_add_ps(
+                    _mm_max_ps(_mm_mul_ps(pz, min_z), _mm_mul_ps(pz, max_z)),
+                    _mm_set1_ps(p.w)
+                )
+            );
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for(size_t j = 0; j < 4; ++j)
+            visible[i+j] = !(mask & (1<<j));
+    }
+
+    for(; i < count; ++i)
+        visible[i] = aabb_frustum_cull(boxes[i], f);
+}
+
 bool sphere_frustum_cull(const sphere& s, const struct frustum& f)
 {
     for(vec4 p: f.planes)
@@ -591,6 +641,30 @@ bool sphere_frustum_cull(const sphere& s, const struct frustum& f)
     return true;
 }
 
+struct frustum bounding_frustum(const struct frustum* frusta, size_t count)
+{
+    struct frustum res;
+    for(size_t k = 0; k < 6; ++k)
+    {
+        vec4 p = count > 0 ? frusta[0].planes[k] : vec4(0);
+        float len = length(vec3(p));
+        p = len > 0.0f ? p / len : vec4(0, 0, 0, 1);
+        for(size_t i = 1; i < count && len > 0.0f; ++i)
+        {
+            vec4 q = frusta[i].planes[k];
+            q /= length(vec3(q));
+            if(dot(vec3(p), vec3(q)) < 1.0f - 1e-6f)
+            {
+                p = vec4(0, 0, 0, 1);
+                break;
+            }
+            p.w = max(p.w, q.w);
+        }
+        res.planes[k] = p;
+    }
+    return res;
+}
+
 aabb aabb_from_obb(const aabb& box, const mat4& transform)
 { // https://zeux.io/2010/10/17/aabb-from-obb-with-component-wise-abs/
     vec3 center = (box.min + box.max) * 0.5f;
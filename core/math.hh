@@ -255,8 +255,21 @@ bool obb_frustum_cull(
 );
 
 bool aabb_frustum_cull(const aabb& box, const struct frustum& f);
+// Same test as above, but for 'count' boxes at once, four at a time with SSE.
+// visible[i] is set to the result of aabb_frustum_cull(boxes[i], f).
+void aabb_frustum_cull_batch(
+    const aabb* boxes,
+    size_t count,
+    const struct frustum& f,
+    bool* visible
+);
 bool sphere_frustum_cull(const sphere& s, const struct frustum& f);
 
+// Returns a frustum containing all given frusta, assuming they only differ by
+// translation (e.g. a grid of multiview cameras). Planes whose normals differ
+// between the frusta are replaced with planes that never cull anything.
+struct frustum bounding_frustum(const struct frustum* frusta, size_t count);
+
 aabb aabb_from_obb(const aabb& box, const mat4& transform);
 bool aabb_overlap(const aabb& a, const aabb& b);
 bool aabb_contains(const aabb& a, const vec3& p);
@@ -1,6 +1,7 @@
 #ifndef RAYBASE_RESOURCE_STORE_HH
 #define RAYBASE_RESOURCE_STORE_HH
 #include "filesystem.hh"
+#include "thread_pool.hh"
 #include "types.hh"
 #include "error.hh"
 #include <unordered_map>
@@ -53,6 +54,14 @@ private:
     std::optional<T> resource;
 };
 
+// Loading priority for resource_store::load() and get(). All thread pool tasks
+// started for loading the resource get at least this priority, so resources
+// needed right away can overtake the rest of a loading screen.
+struct load_priority
+{
+    uint32_t value = 0;
+};
+
 // You should use the resource store to avoid unnecessary duplication of
 // resources, and it can also be used to abstract the filesystem.
 //
@@ -86,6 +95,11 @@ public:
     // to access it once it is available.
     template<typename T, typename... Args>
     resource_loader<T>& load(const std::string& filename, Args&&... args);
+    // Priority only applies if the resource is not already being loaded.
+    template<typename T, typename... Args>
+    resource_loader<T>& load(
+        load_priority priority, const std::string& filename, Args&&... args
+    );
 
     // Starts loading the given resource and if necessary, waits until a handle
     // can be given. This does not mean that the resource is fully loaded; for
@@ -93,6 +107,8 @@ public:
     // finish loading.
     template<typename T, typename... Args>
     T& get(const std::string& filename, Args&&... args);
+    template<typename T, typename... Args>
+    T& get(load_priority priority, const std::string& filename, Args&&... args);
 
     // Used for checking if some resource is still being asynchronously loaded.
     // Whenever you call get() for a new resource, this function may return true
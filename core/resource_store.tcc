@@ -84,6 +84,14 @@ resource_loader<T>& resource_store::load(const std::string& filename, Args&&...
     }
 }
 
+template<typename T, typename... Args>
+resource_loader<T>& resource_store::load(
+    load_priority priority, const std::string& filename, Args&&... args
+){
+    thread_pool::priority_scope scope(priority.value);
+    return load<T>(filename, std::forward<Args>(args)...);
+}
+
 template<typename T, typename... Args>
 T& resource_store::get(const std::string& filename, Args&&... args)
 {
@@ -94,6 +102,14 @@ T& resource_store::get(const std::string& filename, Args&&... args)
     return *ld.get();
 }
 
+template<typename T, typename... Args>
+T& resource_store::get(
+    load_priority priority, const std::string& filename, Args&&... args
+){
+    thread_pool::priority_scope scope(priority.value);
+    return get<T>(filename, std::forward<Args>(args)...);
+}
+
 template<typename T>
 size_t resource_store::resource_pool<T>::get_total_resource_count() const
 {
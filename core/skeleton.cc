@@ -49,6 +49,7 @@ time_ticks skeleton::set_animation(const std::string& name)
     for(joint& j: joints)
     {
         j.cur_anim = nullptr;
+        j.cur_anim_cursor = {};
         if(!j.pool) continue;
 
         auto it = j.pool->find(name);
@@ -70,7 +71,7 @@ time_ticks skeleton::set_animation(const std::string& name)
 void skeleton::apply_animation(time_ticks time)
 {
     for(joint& j: joints)
-        if(j.cur_anim) j.cur_anim->apply(j.node, time);
+        if(j.cur_anim) j.cur_anim->apply(j.node, time, j.cur_anim_cursor);
 }
 
 skeleton& skeleton::operator=(skeleton&& other) noexcept
@@ -253,6 +254,16 @@ void* skeleton::refresh_joint_transforms()
     return mat_joints ? (void*)mat_joints->data() : (void*)dq_joints->data();
 }
 
+void skeleton::update_root_parent_transforms() const
+{
+    for(const joint& j: joints)
+    {
+        transformable* parent = j.node.get_parent();
+        if(j.root && parent)
+            parent->update_cached_transform();
+    }
+}
+
 void skeleton::copy_joint_hierarchy(const skeleton& from)
 {
     // Just copy the joints, then shift all parent addresses that resided in
@@ -18,6 +18,7 @@ public:
         mat4 inverse_bind_matrix = mat4(1.0f);
         const rigid_animation_pool* pool = nullptr;
         const rigid_animation* cur_anim = nullptr;
+        rigid_animation::cursor cur_anim_cursor;
         bool root = true;
 
         enum constraint_type
@@ -93,6 +94,12 @@ public:
     bool is_dirty() const;
     void* refresh_joint_transforms();
 
+    // Updates the cached transforms of the parents of root joints. After
+    // this, refresh_joint_transforms() only touches this skeleton, so
+    // different skeletons can be refreshed concurrently even if they share a
+    // parent.
+    void update_root_parent_transforms() const;
+
 private:
     void copy_joint_hierarchy(const skeleton& from);
 
@@ -1,5 +1,12 @@
 #include "thread_pool.hh"
 
+namespace
+{
+
+thread_local uint32_t inherited_priority = 0;
+
+}
+
 namespace rb
 {
 
@@ -74,6 +81,22 @@ void thread_pool::ticket::wait()
     internal_finished = true;
 }
 
+thread_pool::priority_scope::priority_scope(uint32_t priority)
+: prev_priority(inherited_priority)
+{
+    inherited_priority = std::max(priority, inherited_priority);
+}
+
+thread_pool::priority_scope::~priority_scope()
+{
+    inherited_priority = prev_priority;
+}
+
+uint32_t thread_pool::get_inherited_priority()
+{
+    return inherited_priority;
+}
+
 bool thread_pool::find_task(uint32_t min_priority, task& t)
 {
     if(
@@ -112,6 +135,7 @@ thread_pool::ticket thread_pool::add_task(
     uint32_t priority,
     argvec<ticket> wait_tickets
 ){
+    priority = std::max(priority, inherited_priority);
     uint64_t id = 0;
     {
         std::unique_lock lk(task_mutex);
@@ -161,6 +185,7 @@ thread_pool::ticket thread_pool::add_tasks(
     if(f.size() == 0)
         return ticket(*this, -1);
 
+    priority = std::max(priority, inherited_priority);
     uint64_t id = 0;
     {
         std::unique_lock lk(task_mutex);
@@ -378,7 +403,14 @@ void thread_pool::finish_inner(uint64_t ticket_id)
 void thread_pool::run_task_inner(task& t)
 {
     if(t.func)
+    {
+        // The task may be run by a thread that's waiting for something else,
+        // so the previous inherited priority must be restored afterwards.
+        uint32_t prev_priority = inherited_priority;
+        inherited_priority = t.priority;
         t.func();
+        inherited_priority = prev_priority;
+    }
 
     bool ticket_finished = false;
     {
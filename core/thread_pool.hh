@@ -59,6 +59,23 @@ public:
         argvec<ticket> wait_tickets = {}
     );
 
+    // Tasks added from within a running task inherit its priority if it is
+    // higher than their own, so work spawned by an urgent task is urgent too.
+    // priority_scope does the same for tasks added by the current thread
+    // outside of the pool.
+    class priority_scope
+    {
+    public:
+        priority_scope(uint32_t priority);
+        priority_scope(const priority_scope& other) = delete;
+        ~priority_scope();
+
+    private:
+        uint32_t prev_priority;
+    };
+
+    static uint32_t get_inherited_priority();
+
     // Effectively condenses multiple tickets into one.
     ticket add_barrier(argvec<ticket> wait_tickets = {});
 
@@ -10,9 +10,14 @@
 #include "gfx/external/stb_image.h"
 #include "phys/collider.hh"
 #include "phys/skeleton_collider.hh"
+#include "core/io.hh"
 #include <glm/gtc/type_ptr.hpp>
 #include <stdexcept>
 #include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <type_traits>
 
 namespace
 {
@@ -21,35 +26,13 @@ using namespace rb::gfx;
 using namespace rb::phys;
 using namespace rb::extra;
 
-void flip_lines(unsigned pitch, unsigned char* line_a, unsigned char* line_b)
+bool check_opaque(const std::vector<unsigned char>& rgba, int bits)
 {
-    for(unsigned i = 0; i < pitch; ++i)
-    {
-        unsigned char tmp = line_a[i];
-        line_a[i] = line_b[i];
-        line_b[i] = tmp;
-    }
-}
-
-void flip_vector_image(std::vector<unsigned char>& image, unsigned height)
-{
-    unsigned pitch = image.size() / height;
-    for(unsigned i = 0; i < height/2; ++i)
-        flip_lines(
-            pitch,
-            image.data()+i*pitch,
-            image.data()+(height-1-i)*pitch
-        );
-}
-
-bool check_opaque(tinygltf::Image& img)
-{
-    if(img.component != 4) return true;
-    if(img.bits == 8)
+    if(bits == 8)
     {
         // Check that every fourth (alpha) value is 255.
-        for(size_t i = 3; i < img.image.size(); i += 4)
-            if(img.image[i] != 255)
+        for(size_t i = 3; i < rgba.size(); i += 4)
+            if(rgba[i] != 255)
                 return false;
         return true;
     }
@@ -158,14 +141,13 @@ std::vector<T> read_accessor(tinygltf::Model& model, int index)
 }
 
 template<typename T>
-std::vector<animation_sample<T>> read_animation_accessors(
-    tinygltf::Model& model, int input, int output, bool expect_tangents
+std::vector<animation_sample<T>> build_animation_samples(
+    const std::vector<float>& timestamps,
+    const std::vector<T>& data,
+    bool expect_tangents
 ){
     std::vector<animation_sample<T>> res;
 
-    std::vector<float> timestamps = read_accessor<float>(model, input);
-    std::vector<T> data = read_accessor<T>(model, output);
-
     res.resize(timestamps.size());
     for(size_t i = 0; i < res.size(); ++i)
     {
@@ -184,14 +166,13 @@ std::vector<animation_sample<T>> read_animation_accessors(
 }
 
 template<typename T>
-std::vector<animation_sample<std::vector<T>>> read_animation_accessors_vector(
-    tinygltf::Model& model, int input, int output, bool expect_tangents
+std::vector<animation_sample<std::vector<T>>> build_animation_samples_vector(
+    const std::vector<float>& timestamps,
+    const std::vector<T>& data,
+    bool expect_tangents
 ){
     std::vector<animation_sample<std::vector<T>>> res;
 
-    std::vector<float> timestamps = read_accessor<float>(model, input);
-    std::vector<T> data = read_accessor<T>(model, output);
-
     size_t out_vec_size = data.size() / timestamps.size();
     if(expect_tangents) out_vec_size /= 3;
 
@@ -267,12 +248,9 @@ phys::shape* create_convex_hull_shape(
     return new phys::shape(*pctx, phys::shape::convex_hull{std::move(points)}, params);
 }
 
-phys::shape* create_mesh_shape(
-    phys::context* pctx,
+phys::shape::static_mesh read_static_mesh(
     tinygltf::Model& model,
-    tinygltf::Mesh& mesh,
-    phys::shape::params params,
-    bool bvh
+    tinygltf::Mesh& mesh
 ){
     std::vector<uint32_t> indices;
     std::vector<vec3> points;
@@ -298,17 +276,7 @@ phys::shape* create_mesh_shape(
         }
         indices.insert(indices.end(), tmp_indices.begin(), tmp_indices.end());
     }
-    return bvh ?
-        new phys::shape(
-            *pctx,
-            phys::shape::static_mesh{std::move(indices), std::move(points)},
-            params
-        ) :
-        new phys::shape(
-            *pctx,
-            phys::shape::dynamic_mesh{std::move(indices), std::move(points)},
-            params
-        );
+    return phys::shape::static_mesh{std::move(indices), std::move(points), {}};
 }
 
 void load_gltf_constraint(
@@ -473,10 +441,102 @@ collider create_gltf_collider(
     return c;
 }
 
+// Only keeps the encoded image, decoding is done later by
+// create_embedded_texture().
+bool defer_image_load(
+    tinygltf::Image* image,
+    const int,
+    std::string* err,
+    std::string*,
+    int,
+    int,
+    const unsigned char* bytes,
+    int size,
+    void*
+){
+    int w = 0, h = 0, comp = 0;
+    if(!stbi_info_from_memory(bytes, size, &w, &h, &comp))
+    {
+        if(err) *err += "Unknown image format for image " + image->name + "\n";
+        return false;
+    }
+    image->width = w;
+    image->height = h;
+    image->component = comp;
+    image->as_is = true;
+    image->image.assign(bytes, bytes + size);
+    return true;
+}
+
+// Embedded images keep their encoded bytes, others are loaded from 'uri'.
+struct image_source
+{
+    std::string name;
+    std::string uri;
+    std::vector<unsigned char> encoded;
+};
+
+texture* create_embedded_texture(device& dev, image_source& image)
+{
+    const unsigned char* bytes = image.encoded.data();
+    int size = image.encoded.size();
+    int w = 0, h = 0, comp = 0;
+    int bits = 8;
+    unsigned char* pixels = nullptr;
+
+    // Embedded images are used as stored, and are always expanded to RGBA.
+    stbi_set_flip_vertically_on_load_thread(false);
+    if(stbi_is_16_bit_from_memory(bytes, size))
+    {
+        pixels = (unsigned char*)stbi_load_16_from_memory(bytes, size, &w, &h, &comp, 4);
+        if(pixels) bits = 16;
+    }
+    if(!pixels)
+        pixels = stbi_load_from_memory(bytes, size, &w, &h, &comp, 4);
+    RB_CHECK(!pixels, "Failed to decode embedded image ", image.name);
+
+    std::vector<unsigned char> rgba(
+        pixels, pixels + size_t(w) * h * 4 * (bits / 8)
+    );
+    stbi_image_free(pixels);
+
+    // The encoded image isn't needed anymore, so there's no reason to keep
+    // it around until the end of loading.
+    image.encoded = std::vector<unsigned char>();
+
+    VkFormat format = bits == 8 ?
+        VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R16G16B16A16_UNORM;
+    return new texture(
+        dev,
+        {
+            uvec3(w, h, 1),
+            format,
+            1,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_VIEW_TYPE_2D,
+            true,
+            check_opaque(rgba, bits)
+        },
+        rgba.size(),
+        rgba.data()
+    );
+}
+
+// Lets tinygltf read through our filesystem, and records the external files
+// it reads so that they can be tracked by the cooked cache.
+struct gltf_file_access
+{
+    filesystem* fs;
+    std::vector<std::string> read_files;
+};
+
 bool file_exists_adapter(const std::string& name, void* userdata)
 {
-    filesystem* fs = static_cast<filesystem*>(userdata);
-    return fs->exists(name);
+    gltf_file_access* access = static_cast<gltf_file_access*>(userdata);
+    return access->fs->exists(name);
 }
 
 bool read_file_adapter(
@@ -485,12 +545,13 @@ bool read_file_adapter(
     const std::string& name,
     void* userdata
 ){
-    filesystem* fs = static_cast<filesystem*>(userdata);
+    gltf_file_access* access = static_cast<gltf_file_access*>(userdata);
     try
     {
-        file f = fs->get(name);
+        file f = access->fs->get(name);
         data->resize(f.get_size());
         memcpy(data->data(), f.get_data(), f.get_size());
+        access->read_files.push_back(name);
         return true;
     }
     catch(std::runtime_error& ex)
@@ -721,6 +782,928 @@ primitive::vertex_data load_vertex_data(
     return vd;
 }
 
+struct primitive_source
+{
+    primitive::vertex_data vd;
+    std::vector<primitive::vertex_data> morph_targets;
+    aabb bounding_box;
+    bool has_bounding_box = false;
+};
+
+void load_primitive_source(
+    tinygltf::Model& gltf_model,
+    tinygltf::Primitive& p,
+    primitive_source& ps,
+    const gltf_data::options& opt
+){
+    ps.vd = load_vertex_data(
+        gltf_model, p.attributes, &ps.bounding_box, &ps.has_bounding_box
+    );
+
+    for(auto& attributes: p.targets)
+        ps.morph_targets.push_back(load_vertex_data(gltf_model, attributes));
+
+    ps.vd.index = read_accessor<uint32_t>(gltf_model, p.indices);
+    ps.vd.ensure_attributes(
+        primitive::POSITION|
+        primitive::NORMAL|
+        primitive::TANGENT|
+        primitive::TEXTURE_UV|
+        primitive::LIGHTMAP_UV
+    );
+
+    if(opt.optimize_meshes)
+    {
+        std::vector<primitive::vertex_data*> morph_targets;
+        for(primitive::vertex_data& vd: ps.morph_targets)
+            morph_targets.push_back(&vd);
+        ps.vd.optimize(opt.optimize_overdraw, morph_targets);
+    }
+}
+
+struct sampler_source
+{
+    VkFilter min = VK_FILTER_LINEAR;
+    VkFilter mag = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode extension = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    uint32_t use_mipmaps = true;
+};
+
+sampler_source read_sampler_source(const tinygltf::Sampler& gltf_sampler)
+{
+    sampler_source ss;
+    switch(gltf_sampler.minFilter)
+    {
+    case TINYGLTF_TEXTURE_FILTER_NEAREST:
+        ss.min = VK_FILTER_NEAREST;
+        ss.use_mipmaps = false;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
+        ss.min = VK_FILTER_NEAREST;
+        ss.use_mipmaps = true;
+        ss.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
+        ss.min = VK_FILTER_NEAREST;
+        ss.use_mipmaps = true;
+        ss.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_LINEAR:
+        ss.min = VK_FILTER_LINEAR;
+        ss.use_mipmaps = false;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST:
+        ss.min = VK_FILTER_LINEAR;
+        ss.use_mipmaps = true;
+        ss.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR:
+        ss.min = VK_FILTER_LINEAR;
+        ss.use_mipmaps = true;
+        ss.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        break;
+    default:
+        break;
+    }
+
+    switch(gltf_sampler.magFilter)
+    {
+    case TINYGLTF_TEXTURE_FILTER_NEAREST:
+        ss.mag = VK_FILTER_NEAREST;
+        break;
+    case TINYGLTF_TEXTURE_FILTER_LINEAR:
+        ss.mag = VK_FILTER_LINEAR;
+        break;
+    default:
+        break;
+    }
+
+    switch(gltf_sampler.wrapS)
+    {
+    case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+        ss.extension = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        break;
+    case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+        ss.extension = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+        break;
+    case TINYGLTF_TEXTURE_WRAP_REPEAT:
+        ss.extension = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        break;
+    default:
+        break;
+    }
+    return ss;
+}
+
+struct mesh_source
+{
+    std::string name;
+    std::vector<float> weights;
+    // Material index of each primitive, or -1.
+    std::vector<int32_t> materials;
+};
+
+struct animation_channel_source
+{
+    std::string animation;
+    int32_t target_node = -1;
+    std::string target_path;
+    interpolation interp = LINEAR;
+    std::vector<float> timestamps;
+    // Only the one matching target_path is filled.
+    std::vector<vec3> vec3_data;
+    std::vector<quat> quat_data;
+    std::vector<float> float_data;
+};
+
+struct skin_source
+{
+    std::string name;
+    int32_t skeleton = -1;
+    std::vector<int> joints;
+    std::vector<mat4> inverse_bind_matrices;
+};
+
+// Collision shapes are shared between all nodes using the same mesh.
+struct shape_source
+{
+    int32_t mesh = -1;
+    phys::shape::static_mesh data;
+};
+
+// Everything that load_resources() needs from the file, other than the node
+// hierarchy which stays in the tinygltf model. It's either read from the
+// glTF file or from its cooked version.
+struct gltf_source
+{
+    std::vector<sampler_source> samplers;
+    std::vector<image_source> images;
+    std::vector<material> materials;
+    // Sampler and texture index of each texture slot of each material, only
+    // when uncooked. They're resolved once the textures exist.
+    std::vector<ivec2> material_textures;
+    std::vector<mesh_source> meshes;
+    std::vector<primitive_source> primitives;
+    std::vector<animation_channel_source> animation_channels;
+    std::vector<skin_source> skins;
+    std::vector<shape_source> shapes;
+};
+
+// Reads everything except for vertex data, which is read in parallel
+// afterwards, and materials, which need the textures to exist first.
+void read_gltf_source(tinygltf::Model& gltf_model, gltf_source& src, bool shapes)
+{
+    for(tinygltf::Sampler& gltf_sampler: gltf_model.samplers)
+        src.samplers.push_back(read_sampler_source(gltf_sampler));
+
+    for(tinygltf::Image& image: gltf_model.images)
+    {
+        image_source& is = src.images.emplace_back();
+        is.name = image.name;
+        if(image.bufferView != -1) // Embedded image
+            is.encoded = std::move(image.image);
+        else is.uri = image.uri;
+    }
+
+    for(tinygltf::Mesh& mesh: gltf_model.meshes)
+    {
+        mesh_source& ms = src.meshes.emplace_back();
+        ms.name = mesh.name;
+        ms.weights.insert(ms.weights.end(), mesh.weights.begin(), mesh.weights.end());
+        for(tinygltf::Primitive& p: mesh.primitives)
+            ms.materials.push_back(p.material);
+    }
+
+    for(tinygltf::Animation& anim: gltf_model.animations)
+    {
+        for(tinygltf::AnimationChannel& chan: anim.channels)
+        {
+            bool is_vec3 =
+                chan.target_path == "translation" || chan.target_path == "scale";
+            bool is_quat = chan.target_path == "rotation";
+            bool is_float = chan.target_path == "weights";
+            // Unknown target type
+            if(!is_vec3 && !is_quat && !is_float)
+                continue;
+
+            tinygltf::AnimationSampler& sampler = anim.samplers[chan.sampler];
+            animation_channel_source& cs = src.animation_channels.emplace_back();
+            cs.animation = anim.name;
+            cs.target_node = chan.target_node;
+            cs.target_path = chan.target_path;
+
+            if(sampler.interpolation == "LINEAR") cs.interp = LINEAR;
+            else if(sampler.interpolation == "STEP") cs.interp = STEP;
+            else if(sampler.interpolation == "CUBICSPLINE")
+                cs.interp = CUBICSPLINE;
+
+            cs.timestamps = read_accessor<float>(gltf_model, sampler.input);
+            if(is_vec3)
+                cs.vec3_data = read_accessor<vec3>(gltf_model, sampler.output);
+            else if(is_quat)
+                cs.quat_data = read_accessor<quat>(gltf_model, sampler.output);
+            else
+                cs.float_data = read_accessor<float>(gltf_model, sampler.output);
+        }
+    }
+
+    for(tinygltf::Skin& skin: gltf_model.skins)
+    {
+        skin_source& ss = src.skins.emplace_back();
+        ss.name = skin.name;
+        ss.skeleton = skin.skeleton;
+        ss.joints = skin.joints;
+        if(skin.inverseBindMatrices >= 0)
+            ss.inverse_bind_matrices = read_accessor<mat4>(
+                gltf_model, skin.inverseBindMatrices
+            );
+    }
+
+    if(shapes)
+    {
+        std::unordered_set<int> shape_meshes;
+        for(tinygltf::Node& node: gltf_model.nodes)
+        {
+            if(node.mesh < 0 || !shape_meshes.insert(node.mesh).second)
+                continue;
+            src.shapes.emplace_back().mesh = node.mesh;
+        }
+    }
+}
+
+template<typename M, typename F>
+void foreach_material_texture(M& m, F&& f)
+{
+    f(m.color_texture);
+    f(m.metallic_roughness_texture);
+    f(m.normal_texture);
+    f(m.emission_texture);
+    f(m.transmission_translucency_texture);
+    f(m.clearcoat_texture);
+    f(m.clearcoat_normal_texture);
+    f(m.sheen_texture);
+}
+
+constexpr char cooked_magic[4] = {'R', 'B', 'C', 'K'};
+constexpr uint32_t cooked_version = 3;
+
+// Only the options that change the cooked data. pack_vertices and
+// build_meshlets are applied when the primitives are created from it.
+enum cooked_flags: uint32_t
+{
+    COOKED_OPTIMIZED = 1<<0,
+    COOKED_OPTIMIZED_OVERDRAW = 1<<1,
+    COOKED_SHAPES = 1<<2
+};
+
+uint32_t get_cooked_flags(const gltf_data::options& opt, bool shapes)
+{
+    uint32_t flags = 0;
+    if(opt.optimize_meshes)
+    {
+        flags |= COOKED_OPTIMIZED;
+        if(opt.optimize_overdraw)
+            flags |= COOKED_OPTIMIZED_OVERDRAW;
+    }
+    if(shapes)
+        flags |= COOKED_SHAPES;
+    return flags;
+}
+
+// A file that the cooked data was created from.
+struct cooked_dependency
+{
+    std::string name;
+    uint64_t size = 0;
+    uint64_t modification_time = 0;
+    uint64_t hash = 0;
+};
+
+template<typename T>
+void write_cooked_value(std::vector<uint8_t>& out, const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const uint8_t* data = (const uint8_t*)&value;
+    out.insert(out.end(), data, data + sizeof(T));
+}
+
+template<typename T>
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if(size - offset < sizeof(T)) return false;
+    memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+template<typename T>
+void write_cooked_stream(std::vector<uint8_t>& out, const std::vector<T>& v)
+{
+    write_cooked_value(out, uint64_t(v.size()));
+    const uint8_t* data = (const uint8_t*)v.data();
+    out.insert(out.end(), data, data + v.size() * sizeof(T));
+}
+
+template<typename T>
+bool read_cooked_stream(const uint8_t* data, size_t size, size_t& offset, std::vector<T>& v)
+{
+    uint64_t count = 0;
+    if(!read_cooked_value(data, size, offset, count)) return false;
+    if(count > (size - offset) / sizeof(T)) return false;
+    v.resize(count);
+    memcpy(v.data(), data + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+    return true;
+}
+
+// Overloads for everything that isn't trivially copyable. They're declared
+// up front so that the container templates below can find them.
+#define RB_COOKED_TYPE(type) \
+    void write_cooked_value(std::vector<uint8_t>& out, const type& value); \
+    bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, type& value);
+RB_COOKED_TYPE(std::string)
+RB_COOKED_TYPE(tinygltf::Value)
+RB_COOKED_TYPE(tinygltf::Value::Object)
+RB_COOKED_TYPE(tinygltf::Node)
+RB_COOKED_TYPE(tinygltf::Scene)
+RB_COOKED_TYPE(tinygltf::Camera)
+RB_COOKED_TYPE(tinygltf::Light)
+RB_COOKED_TYPE(primitive::vertex_data)
+RB_COOKED_TYPE(primitive_source)
+RB_COOKED_TYPE(image_source)
+RB_COOKED_TYPE(mesh_source)
+RB_COOKED_TYPE(animation_channel_source)
+RB_COOKED_TYPE(skin_source)
+RB_COOKED_TYPE(shape_source)
+RB_COOKED_TYPE(cooked_dependency)
+#undef RB_COOKED_TYPE
+
+template<typename T>
+void write_cooked_value(std::vector<uint8_t>& out, const std::vector<T>& v)
+{
+    if constexpr(std::is_trivially_copyable_v<T>)
+        write_cooked_stream(out, v);
+    else
+    {
+        write_cooked_value(out, uint64_t(v.size()));
+        for(const T& value: v)
+            write_cooked_value(out, value);
+    }
+}
+
+template<typename T>
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, std::vector<T>& v)
+{
+    if constexpr(std::is_trivially_copyable_v<T>)
+        return read_cooked_stream(data, size, offset, v);
+    else
+    {
+        uint64_t count = 0;
+        if(!read_cooked_value(data, size, offset, count)) return false;
+        // Every entry takes at least one byte.
+        if(count > size - offset) return false;
+        v.resize(count);
+        for(T& value: v)
+            if(!read_cooked_value(data, size, offset, value))
+                return false;
+        return true;
+    }
+}
+
+template<typename... Args>
+void write_cooked_values(std::vector<uint8_t>& out, const Args&... args)
+{
+    (write_cooked_value(out, args), ...);
+}
+
+template<typename... Args>
+bool read_cooked_values(const uint8_t* data, size_t size, size_t& offset, Args&... args)
+{
+    return (read_cooked_value(data, size, offset, args) && ...);
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const std::string& value)
+{
+    write_cooked_value(out, uint64_t(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, std::string& value)
+{
+    uint64_t length = 0;
+    if(!read_cooked_value(data, size, offset, length)) return false;
+    if(length > size - offset) return false;
+    value.assign((const char*)data + offset, length);
+    offset += length;
+    return true;
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Value& value)
+{
+    write_cooked_value(out, uint8_t(value.Type()));
+    switch(value.Type())
+    {
+    case tinygltf::BOOL_TYPE:
+        write_cooked_value(out, uint8_t(value.Get<bool>()));
+        break;
+    case tinygltf::INT_TYPE:
+        write_cooked_value(out, int32_t(value.Get<int>()));
+        break;
+    case tinygltf::REAL_TYPE:
+        write_cooked_value(out, value.Get<double>());
+        break;
+    case tinygltf::STRING_TYPE:
+        write_cooked_value(out, value.Get<std::string>());
+        break;
+    case tinygltf::BINARY_TYPE:
+        write_cooked_value(out, value.Get<std::vector<unsigned char>>());
+        break;
+    case tinygltf::ARRAY_TYPE:
+        write_cooked_value(out, value.Get<tinygltf::Value::Array>());
+        break;
+    case tinygltf::OBJECT_TYPE:
+        write_cooked_value(out, value.Get<tinygltf::Value::Object>());
+        break;
+    default:
+        break;
+    }
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Value& value)
+{
+    uint8_t type = 0;
+    if(!read_cooked_value(data, size, offset, type)) return false;
+    switch(type)
+    {
+    case tinygltf::NULL_TYPE:
+        value = tinygltf::Value();
+        return true;
+    case tinygltf::BOOL_TYPE:
+        {
+            uint8_t b = 0;
+            if(!read_cooked_value(data, size, offset, b)) return false;
+            value = tinygltf::Value(b != 0);
+            return true;
+        }
+    case tinygltf::INT_TYPE:
+        {
+            int32_t i = 0;
+            if(!read_cooked_value(data, size, offset, i)) return false;
+            value = tinygltf::Value(int(i));
+            return true;
+        }
+    case tinygltf::REAL_TYPE:
+        {
+            double d = 0;
+            if(!read_cooked_value(data, size, offset, d)) return false;
+            value = tinygltf::Value(d);
+            return true;
+        }
+    case tinygltf::STRING_TYPE:
+        {
+            std::string s;
+            if(!read_cooked_value(data, size, offset, s)) return false;
+            value = tinygltf::Value(std::move(s));
+            return true;
+        }
+    case tinygltf::BINARY_TYPE:
+        {
+            std::vector<unsigned char> b;
+            if(!read_cooked_value(data, size, offset, b)) return false;
+            value = tinygltf::Value(std::move(b));
+            return true;
+        }
+    case tinygltf::ARRAY_TYPE:
+        {
+            tinygltf::Value::Array a;
+            if(!read_cooked_value(data, size, offset, a)) return false;
+            value = tinygltf::Value(std::move(a));
+            return true;
+        }
+    case tinygltf::OBJECT_TYPE:
+        {
+            tinygltf::Value::Object o;
+            if(!read_cooked_value(data, size, offset, o)) return false;
+            value = tinygltf::Value(std::move(o));
+            return true;
+        }
+    default:
+        return false;
+    }
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Value::Object& value)
+{
+    write_cooked_value(out, uint64_t(value.size()));
+    for(const auto& pair: value)
+        write_cooked_values(out, pair.first, pair.second);
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Value::Object& value)
+{
+    uint64_t count = 0;
+    if(!read_cooked_value(data, size, offset, count)) return false;
+    if(count > size - offset) return false;
+    value.clear();
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        std::string key;
+        tinygltf::Value v;
+        if(!read_cooked_values(data, size, offset, key, v)) return false;
+        value.emplace(std::move(key), std::move(v));
+    }
+    return true;
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Node& value)
+{
+    write_cooked_values(
+        out, value.name, value.camera, value.skin, value.mesh, value.children,
+        value.rotation, value.scale, value.translation, value.matrix,
+        value.weights, value.extensions
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Node& value)
+{
+    return read_cooked_values(
+        data, size, offset,
+        value.name, value.camera, value.skin, value.mesh, value.children,
+        value.rotation, value.scale, value.translation, value.matrix,
+        value.weights, value.extensions
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Scene& value)
+{
+    write_cooked_values(out, value.name, value.nodes);
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Scene& value)
+{
+    return read_cooked_values(data, size, offset, value.name, value.nodes);
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Camera& value)
+{
+    write_cooked_values(
+        out, value.type, value.name,
+        value.perspective.aspectRatio, value.perspective.yfov,
+        value.perspective.zfar, value.perspective.znear,
+        value.orthographic.xmag, value.orthographic.ymag,
+        value.orthographic.zfar, value.orthographic.znear
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Camera& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.type, value.name,
+        value.perspective.aspectRatio, value.perspective.yfov,
+        value.perspective.zfar, value.perspective.znear,
+        value.orthographic.xmag, value.orthographic.ymag,
+        value.orthographic.zfar, value.orthographic.znear
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const tinygltf::Light& value)
+{
+    write_cooked_values(
+        out, value.name, value.color, value.intensity, value.type,
+        value.range, value.spot.innerConeAngle, value.spot.outerConeAngle
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, tinygltf::Light& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.name, value.color, value.intensity,
+        value.type, value.range, value.spot.innerConeAngle,
+        value.spot.outerConeAngle
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const primitive::vertex_data& value)
+{
+    write_cooked_values(
+        out, value.index, value.position, value.normal, value.tangent,
+        value.texture_uv, value.lightmap_uv, value.joints, value.weights,
+        value.color
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, primitive::vertex_data& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.index, value.position, value.normal,
+        value.tangent, value.texture_uv, value.lightmap_uv, value.joints,
+        value.weights, value.color
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const primitive_source& value)
+{
+    write_cooked_values(
+        out, uint32_t(value.has_bounding_box), value.bounding_box, value.vd,
+        value.morph_targets
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, primitive_source& value)
+{
+    uint32_t has_bounding_box = 0;
+    bool ok = read_cooked_values(
+        data, size, offset, has_bounding_box, value.bounding_box, value.vd,
+        value.morph_targets
+    );
+    value.has_bounding_box = has_bounding_box;
+    return ok;
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const image_source& value)
+{
+    write_cooked_values(out, value.name, value.uri, value.encoded);
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, image_source& value)
+{
+    return read_cooked_values(data, size, offset, value.name, value.uri, value.encoded);
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const mesh_source& value)
+{
+    write_cooked_values(out, value.name, value.weights, value.materials);
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, mesh_source& value)
+{
+    return read_cooked_values(data, size, offset, value.name, value.weights, value.materials);
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const animation_channel_source& value)
+{
+    write_cooked_values(
+        out, value.animation, value.target_node, value.target_path,
+        value.interp, value.timestamps, value.vec3_data, value.quat_data,
+        value.float_data
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, animation_channel_source& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.animation, value.target_node,
+        value.target_path, value.interp, value.timestamps, value.vec3_data,
+        value.quat_data, value.float_data
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const skin_source& value)
+{
+    write_cooked_values(
+        out, value.name, value.skeleton, value.joints,
+        value.inverse_bind_matrices
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, skin_source& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.name, value.skeleton, value.joints,
+        value.inverse_bind_matrices
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const shape_source& value)
+{
+    write_cooked_values(
+        out, value.mesh, value.data.indices, value.data.points,
+        value.data.bvh_data
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, shape_source& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.mesh, value.data.indices, value.data.points,
+        value.data.bvh_data
+    );
+}
+
+void write_cooked_value(std::vector<uint8_t>& out, const cooked_dependency& value)
+{
+    write_cooked_values(
+        out, value.name, value.size, value.modification_time, value.hash
+    );
+}
+
+bool read_cooked_value(const uint8_t* data, size_t size, size_t& offset, cooked_dependency& value)
+{
+    return read_cooked_values(
+        data, size, offset, value.name, value.size, value.modification_time,
+        value.hash
+    );
+}
+
+template<typename T>
+int32_t get_cooked_index(const std::vector<std::unique_ptr<T>>& v, const T* ptr)
+{
+    for(size_t i = 0; ptr && i < v.size(); ++i)
+        if(v[i].get() == ptr)
+            return i;
+    return -1;
+}
+
+// Textures are stored as sampler and texture indices.
+void write_cooked_material(
+    std::vector<uint8_t>& out,
+    const material& m,
+    const std::vector<std::unique_ptr<sampler>>& samplers,
+    const std::vector<std::unique_ptr<texture>>& textures
+){
+    write_cooked_values(
+        out, m.color, m.metallic, m.roughness, m.ior, m.emission,
+        m.transmission, m.translucency, m.volume_attenuation, m.clearcoat,
+        m.clearcoat_roughness, m.anisotropy, m.anisotropy_rotation,
+        m.sheen_color, m.sheen_roughness, uint32_t(m.double_sided),
+        m.alpha_cutoff, m.stencil_reference, uint32_t(m.casts_shadows)
+    );
+    foreach_material_texture(m, [&](const material::sampler_tex& t){
+        write_cooked_value(out, ivec2(
+            get_cooked_index(samplers, t.first),
+            get_cooked_index(textures, t.second)
+        ));
+    });
+}
+
+bool read_cooked_material(
+    const uint8_t* data,
+    size_t size,
+    size_t& offset,
+    material& m,
+    std::vector<ivec2>& material_textures
+){
+    uint32_t double_sided = 0;
+    uint32_t casts_shadows = 0;
+    bool ok = read_cooked_values(
+        data, size, offset, m.color, m.metallic, m.roughness, m.ior,
+        m.emission, m.transmission, m.translucency, m.volume_attenuation,
+        m.clearcoat, m.clearcoat_roughness, m.anisotropy,
+        m.anisotropy_rotation, m.sheen_color, m.sheen_roughness,
+        double_sided, m.alpha_cutoff, m.stencil_reference, casts_shadows
+    );
+    m.double_sided = double_sided;
+    m.casts_shadows = casts_shadows;
+    foreach_material_texture(m, [&](material::sampler_tex&){
+        ivec2 index;
+        ok = ok && read_cooked_value(data, size, offset, index);
+        material_textures.push_back(index);
+    });
+    return ok;
+}
+
+// The name is only used for finding the cooked file, the dependencies stored
+// in it decide whether it's still valid.
+std::string get_cooked_name(const std::string& source_name, uint32_t flags)
+{
+    uint64_t name_hash = hash_data(
+        (const uint8_t*)source_name.data(), source_name.size()
+    );
+    char name[48];
+    snprintf(
+        name, sizeof(name), "%016llx_%08x.rbcook",
+        (unsigned long long)name_hash, flags
+    );
+    return name;
+}
+
+cooked_dependency get_cooked_dependency(const file& f)
+{
+    return {
+        f.get_name(),
+        f.get_size(),
+        f.get_source_filesystem()->get_modification_time(f.get_name()),
+        hash_data(f.get_data(), f.get_size())
+    };
+}
+
+// A changed size always means a changed file, and an unchanged modification
+// time means an unchanged file. The file is only hashed when neither is
+// conclusive.
+bool check_cooked_dependency(filesystem* fs, const cooked_dependency& dep)
+{
+    if(!fs->exists(dep.name)) return false;
+    file f = fs->get(dep.name);
+    if(f.get_size() != dep.size) return false;
+
+    uint64_t modification_time = fs->get_modification_time(dep.name);
+    if(modification_time != 0 && modification_time == dep.modification_time)
+        return true;
+    return hash_data(f.get_data(), f.get_size()) == dep.hash;
+}
+
+void write_cooked_header(
+    std::vector<uint8_t>& out,
+    uint32_t flags,
+    const std::vector<cooked_dependency>& dependencies
+){
+    out.insert(out.end(), cooked_magic, cooked_magic + sizeof(cooked_magic));
+    write_cooked_values(out, cooked_version, flags, dependencies);
+}
+
+// The sections written by load_resources() as their data becomes ready. The
+// header is followed by the node hierarchy and the first part of the source,
+// then primitives, materials and finally collision shapes.
+void write_cooked_structure(
+    std::vector<uint8_t>& out,
+    const tinygltf::Model& gltf_model,
+    const gltf_source& src
+){
+    write_cooked_values(
+        out, gltf_model.nodes, gltf_model.scenes, gltf_model.cameras,
+        gltf_model.lights, src.samplers, src.images, src.meshes,
+        src.animation_channels, src.skins
+    );
+}
+
+// Returns false if the cooked file is stale or broken, in which case the
+// glTF file must be loaded normally. Otherwise, the node hierarchy is loaded
+// into 'gltf_model' and everything else into 'src'.
+bool uncook_gltf(
+    const file& cooked,
+    uint32_t flags,
+    const file& f,
+    tinygltf::Model& gltf_model,
+    gltf_source& src
+){
+    const uint8_t* data = cooked.get_data();
+    size_t size = cooked.get_size();
+    size_t offset = sizeof(cooked_magic);
+    if(size < offset || memcmp(data, cooked_magic, sizeof(cooked_magic)) != 0)
+        return false;
+
+    uint32_t version = 0;
+    uint32_t file_flags = 0;
+    if(
+        !read_cooked_values(data, size, offset, version, file_flags) ||
+        version != cooked_version || file_flags != flags
+    ) return false;
+
+    std::vector<cooked_dependency> dependencies;
+    if(
+        !read_cooked_value(data, size, offset, dependencies) ||
+        dependencies.empty() || dependencies[0].name != f.get_name()
+    ) return false;
+    for(const cooked_dependency& dep: dependencies)
+        if(!check_cooked_dependency(f.get_source_filesystem(), dep))
+            return false;
+
+    uint64_t material_count = 0;
+    if(
+        !read_cooked_values(
+            data, size, offset, gltf_model.nodes, gltf_model.scenes,
+            gltf_model.cameras, gltf_model.lights, src.samplers, src.images,
+            src.meshes, src.animation_channels, src.skins, src.primitives,
+            material_count
+        ) || material_count > size - offset
+    ) return false;
+
+    src.materials.resize(material_count);
+    for(material& m: src.materials)
+        if(!read_cooked_material(data, size, offset, m, src.material_textures))
+            return false;
+
+    if(!read_cooked_value(data, size, offset, src.shapes) || offset != size)
+        return false;
+
+    // Indices are checked here so that a broken file can't crash loading.
+    // The last sampler is the default one.
+    size_t primitive_count = 0;
+    for(const mesh_source& ms: src.meshes)
+    {
+        primitive_count += ms.materials.size();
+        for(int32_t index: ms.materials)
+            if(index >= (int64_t)src.materials.size())
+                return false;
+    }
+    if(primitive_count != src.primitives.size())
+        return false;
+    for(ivec2 index: src.material_textures)
+        if(index.x > (int64_t)src.samplers.size() || index.y >= (int64_t)src.images.size())
+            return false;
+    for(const shape_source& ss: src.shapes)
+        if(ss.mesh < 0 || ss.mesh >= (int64_t)src.meshes.size())
+            return false;
+
+    // Only the mesh names are needed from the tinygltf meshes.
+    gltf_model.meshes.resize(src.meshes.size());
+    for(size_t i = 0; i < src.meshes.size(); ++i)
+        gltf_model.meshes[i].name = src.meshes[i].name;
+    return true;
+}
+
 void count_gltf_skeleton_node(
     tinygltf::Model& gltf_model,
     int node_index,
@@ -1427,232 +2410,234 @@ void gltf_data::load_resources(
 ){
     std::string prefix = fs::path(f.get_name()).parent_path().generic_string();
 
-    std::string err, warn;
     data->subfile_prefix =
         fs::path(f.get_name()).replace_extension(".").generic_string();
     tinygltf::Model& gltf_model = data->gltf_model;
-    tinygltf::TinyGLTF loader;
     filesystem* fs = f.get_source_filesystem();
     data->fs = fs;
 
-    // Use our fancy filesystem with tinygltf
-    loader.SetFsCallbacks({
-        file_exists_adapter,
-        tinygltf::ExpandFilePath,
-        read_file_adapter,
-        nullptr,
-        fs
-    });
+    thread_pool& pool = dev.ctx->get_thread_pool();
 
-    // TinyGLTF uses stb_image too, and expects this value.
-    stbi_set_flip_vertically_on_load(true);
-
-    if(!loader.LoadBinaryFromMemory(
-        &gltf_model, &err, &warn, f.get_data(), f.get_size()
-    )) throw std::runtime_error(err);
-
-    for(tinygltf::Image& image: gltf_model.images)
+    // The cooked cache has everything that would be read from the file, so
+    // when it's valid, the file isn't parsed at all.
+    uint32_t flags = get_cooked_flags(opt, pctx != nullptr);
+    std::string cooked_name = get_cooked_name(f.get_name(), flags);
+    bool use_cooked_cache = !opt.cooked_cache_dir.empty() && fs;
+    bool cooked = false;
+    gltf_source src;
+    if(use_cooked_cache)
     {
-        if(image.bufferView != -1)
-        {// Embedded image
-            VkFormat format;
-
-            switch(image.component)
+        native_filesystem cache_fs(opt.cooked_cache_dir);
+        if(cache_fs.exists(cooked_name))
+        {
+            cooked = uncook_gltf(
+                cache_fs.get(cooked_name), flags, f, gltf_model, src
+            );
+            if(!cooked)
             {
-            case 1:
-                format = image.bits == 8 ? VK_FORMAT_R8_UNORM : VK_FORMAT_R16_UNORM;
-                break;
-            case 2:
-                format = image.bits == 8 ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R16G16_UNORM;
-                break;
-            default:
-            case 3:
-                format = image.bits == 8 ? VK_FORMAT_R8G8B8_UNORM : VK_FORMAT_R16G16B16_UNORM;
-                break;
-            case 4:
-                format = image.bits == 8 ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R16G16B16A16_UNORM;
-                break;
+                gltf_model = tinygltf::Model();
+                src = gltf_source();
             }
+        }
+    }
+    bool write_cooked = use_cooked_cache && !cooked;
+    std::vector<uint8_t> cooked_data;
 
-            flip_vector_image(image.image, image.height);
-            if(image.component == 3 && image.bits == 8)
-            {
-                RB_CHECK(
-                    image.pixel_type != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
-                    "16-bit channel interlacing not implemented yet"
-                );
-                std::vector<uint8_t> new_image(image.image.size()/3*4, 0);
-                uint8_t fill = 255;
-                interlace(
-                    new_image.data(),
-                    image.image.data(),
-                    &fill,
-                    3, 4,
-                    image.width*image.height
-                );
-                image.image = std::move(new_image);
-                format = VK_FORMAT_R8G8B8A8_UNORM;
-            }
+    if(!cooked)
+    {
+        std::string err, warn;
+        tinygltf::TinyGLTF loader;
+        gltf_file_access access{fs, {}};
+
+        // Use our fancy filesystem with tinygltf
+        loader.SetFsCallbacks({
+            file_exists_adapter,
+            tinygltf::ExpandFilePath,
+            read_file_adapter,
+            nullptr,
+            &access
+        });
+
+        // Images are only decoded once parsing is done, so that they can be
+        // decoded in parallel.
+        loader.SetImageLoader(defer_image_load, nullptr);
+
+        if(!loader.LoadBinaryFromMemory(
+            &gltf_model, &err, &warn, f.get_data(), f.get_size()
+        )) throw std::runtime_error(err);
+
+        read_gltf_source(gltf_model, src, pctx != nullptr);
+
+        if(write_cooked)
+        {
+            // External buffers hold the vertex data, so they're dependencies
+            // too.
+            std::vector<cooked_dependency> dependencies = {
+                get_cooked_dependency(f)
+            };
+            for(const std::string& name: access.read_files)
+                dependencies.push_back(get_cooked_dependency(fs->get(name)));
+            write_cooked_header(cooked_data, flags, dependencies);
+            write_cooked_structure(cooked_data, gltf_model, src);
+        }
+    }
 
-            data->textures.emplace_back(new texture(
-                dev,
-                {
-                    uvec3(image.width, image.height, 1),
-                    format,
-                    1,
-                    VK_IMAGE_TILING_OPTIMAL,
-                    VK_IMAGE_USAGE_SAMPLED_BIT,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                    VK_SAMPLE_COUNT_1_BIT,
-                    VK_IMAGE_VIEW_TYPE_2D,
-                    true,
-                    check_opaque(image)
-                },
-                image.image.size(),
-                image.image.data()
+    std::vector<size_t> mesh_primitive_offsets;
+    size_t primitive_count = 0;
+    for(const mesh_source& ms: src.meshes)
+    {
+        mesh_primitive_offsets.push_back(primitive_count);
+        primitive_count += ms.materials.size();
+    }
+
+    // Collision shapes only need the mesh data, so they can be built while
+    // everything else is loading. Cooked shapes come with their BVH.
+    std::vector<std::function<void()>> shape_tasks;
+    for(shape_source& ss: src.shapes)
+    {
+        shape_tasks.push_back([
+            pctx, &gltf_model, &ss, &sa = data->shared_shapes[ss.mesh],
+            cooked, write_cooked
+        ](){
+            if(!cooked)
+                ss.data = read_static_mesh(gltf_model, gltf_model.meshes[ss.mesh]);
+            // The mesh data is still needed for cooking.
+            sa.bvh.reset(new phys::shape(
+                *pctx,
+                write_cooked ?
+                    phys::shape::static_mesh(ss.data) : std::move(ss.data),
+                {}
             ));
+        });
+    }
+    thread_pool::ticket shape_ticket = pool.add_tasks(shape_tasks);
+
+    data->textures.resize(src.images.size());
+    std::vector<std::function<void()>> image_tasks;
+    for(size_t i = 0; i < src.images.size(); ++i)
+    {
+        image_source& image = src.images[i];
+        if(image.uri.empty())
+        {// Embedded image
+            image_tasks.push_back([&dev, &image, &tex = data->textures[i]](){
+                tex.reset(create_embedded_texture(dev, image));
+            });
         }
         else
         {// URI
-            data->textures.emplace_back(
+            data->textures[i].reset(
                 new texture(dev, fs->get(prefix + "/" + image.uri))
             );
         }
     }
+    thread_pool::ticket image_ticket = pool.add_tasks(image_tasks);
 
-    for(tinygltf::Sampler& gltf_sampler: gltf_model.samplers)
+    // Reading the vertex data and generating missing attributes is done per
+    // primitive.
+    std::vector<std::function<void()>> vertex_tasks;
+    if(!cooked)
     {
-        VkFilter min = VK_FILTER_LINEAR;
-        VkFilter mag = VK_FILTER_LINEAR;
-        VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        VkSamplerAddressMode extension = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        bool use_mipmaps = true;
-
-        switch(gltf_sampler.minFilter)
+        src.primitives.resize(primitive_count);
+        for(size_t i = 0; i < gltf_model.meshes.size(); ++i)
         {
-        case TINYGLTF_TEXTURE_FILTER_NEAREST:
-            min = VK_FILTER_NEAREST;
-            use_mipmaps = false;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
-            min = VK_FILTER_NEAREST;
-            use_mipmaps = true;
-            mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
-            min = VK_FILTER_NEAREST;
-            use_mipmaps = true;
-            mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_LINEAR:
-            min = VK_FILTER_LINEAR;
-            use_mipmaps = false;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST:
-            min = VK_FILTER_LINEAR;
-            use_mipmaps = true;
-            mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR:
-            min = VK_FILTER_LINEAR;
-            use_mipmaps = true;
-            mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-            break;
-        default:
-            break;
-        }
-
-        switch(gltf_sampler.magFilter)
-        {
-        case TINYGLTF_TEXTURE_FILTER_NEAREST:
-            mag = VK_FILTER_NEAREST;
-            break;
-        case TINYGLTF_TEXTURE_FILTER_LINEAR:
-            mag = VK_FILTER_LINEAR;
-            break;
-        default:
-            break;
+            tinygltf::Mesh& mesh = gltf_model.meshes[i];
+            for(size_t j = 0; j < mesh.primitives.size(); ++j)
+            {
+                vertex_tasks.push_back([
+                    &gltf_model, &p = mesh.primitives[j],
+                    &ps = src.primitives[mesh_primitive_offsets[i] + j], &opt
+                ](){
+                    load_primitive_source(gltf_model, p, ps, opt);
+                });
+            }
         }
+    }
+    thread_pool::ticket vertex_ticket = pool.add_tasks(vertex_tasks);
 
-        switch(gltf_sampler.wrapS)
-        {
-        case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
-            extension = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-            break;
-        case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
-            extension = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
-            break;
-        case TINYGLTF_TEXTURE_WRAP_REPEAT:
-            extension = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-            break;
-        default:
-            break;
-        }
+    for(const sampler_source& ss: src.samplers)
+    {
         data->samplers.emplace_back(new sampler(
             dev,
-            min,
-            mag,
-            mipmap_mode,
-            extension,
+            ss.min,
+            ss.mag,
+            ss.mipmap_mode,
+            ss.extension,
             16,
-            use_mipmaps ? 100.0f : 0.0f
+            ss.use_mipmaps ? 100.0f : 0.0f
         ));
     }
     data->samplers.emplace_back(new sampler(dev));
 
-    bool has_lightmap_uvs = false;
+    vertex_ticket.wait();
+    if(write_cooked)
+        write_cooked_value(cooked_data, src.primitives);
+
+    // Materials need to know whether their textures are opaque.
+    image_ticket.wait();
+    if(cooked)
+    {
+        size_t slot = 0;
+        for(material& m: src.materials)
+        {
+            foreach_material_texture(m, [&](material::sampler_tex& t){
+                ivec2 index = src.material_textures[slot++];
+                t.first = index.x >= 0 ? data->samplers[index.x].get() : nullptr;
+                t.second = index.y >= 0 ? data->textures[index.y].get() : nullptr;
+            });
+        }
+    }
+    else
+    {
+        for(tinygltf::Material& gltf_material: gltf_model.materials)
+        {
+            src.materials.push_back(create_material(
+                gltf_material, gltf_model, data->samplers, data->textures
+            ));
+        }
+    }
+
+    if(write_cooked)
+    {
+        write_cooked_value(cooked_data, uint64_t(src.materials.size()));
+        for(const material& m: src.materials)
+            write_cooked_material(cooked_data, m, data->samplers, data->textures);
+    }
+
     node_meta_info& meta = data->meta;
-    for(tinygltf::Mesh& mesh: gltf_model.meshes)
+    for(size_t i = 0; i < src.meshes.size(); ++i)
     {
+        mesh_source& ms = src.meshes[i];
         model mod;
         rb::gfx::mesh& me = *data->meshes.emplace_back(new rb::gfx::mesh(dev));
         mod.m = &me;
 
         size_t morph_target_count = 0;
-        for(tinygltf::Primitive& p: mesh.primitives)
+        for(size_t j = 0; j < ms.materials.size(); ++j)
         {
-            aabb bounding_box;
-            bool has_bounding_box = false;
-
-            primitive::vertex_data vd = load_vertex_data(gltf_model, p.attributes, &bounding_box, &has_bounding_box);
-
-            bool current_has_lightmap_uvs = false;
-            if(vd.lightmap_uv.size() != 0)
-                has_lightmap_uvs = current_has_lightmap_uvs = true;
+            primitive_source& ps = src.primitives[mesh_primitive_offsets[i] + j];
+            aabb bounding_box = ps.bounding_box;
+            bool has_bounding_box = ps.has_bounding_box;
 
             std::vector<const primitive*> morph_targets;
-            for(auto& attributes: p.targets)
+            for(primitive::vertex_data& vd: ps.morph_targets)
             {
-                primitive::vertex_data vd = load_vertex_data(gltf_model, attributes);
                 morph_targets.push_back(data->primitives.emplace_back(new primitive(
                     dev, std::move(vd)
                 )).get());
             }
-            morph_target_count = max(morph_target_count, p.targets.size());
-
-            vd.index = read_accessor<uint32_t>(gltf_model, p.indices);
-            vd.ensure_attributes(
-                primitive::POSITION|
-                primitive::NORMAL|
-                primitive::TANGENT|
-                primitive::TEXTURE_UV|
-                primitive::LIGHTMAP_UV
-            );
+            morph_target_count = max(morph_target_count, ps.morph_targets.size());
 
             material mat;
-            if(p.material >= 0)
-            {
-                mat = create_material(
-                    gltf_model.materials[p.material], gltf_model,
-                    data->samplers, data->textures
-                );
-            }
-            bool is_animated = vd.joints.size() != 0 || morph_targets.size() != 0;
+            if(ms.materials[j] >= 0)
+                mat = src.materials[ms.materials[j]];
+            bool is_animated = ps.vd.joints.size() != 0 || morph_targets.size() != 0;
 
             data->primitives.emplace_back(new primitive(
                 dev,
-                std::move(vd),
-                !mat.potentially_transparent()
+                std::move(ps.vd),
+                !mat.potentially_transparent(),
+                opt.pack_vertices,
+                opt.build_meshlets && !is_animated
             ));
 
             if(!has_bounding_box)
@@ -1678,15 +2663,47 @@ void gltf_data::load_resources(
             );
             mod.materials.push_back(mat);
         }
-        std::vector<float> weights;
-        weights.insert(weights.end(), mesh.weights.begin(), mesh.weights.end());
+        std::vector<float> weights = ms.weights;
 
         if(weights.size() < morph_target_count)
             weights.resize(morph_target_count, 0);
 
         me.set_morph_target_weights(weights);
 
-        meta.models[mesh.name] = mod;
+        meta.models[ms.name] = mod;
+    }
+
+    shape_ticket.wait();
+    if(write_cooked)
+    {
+        for(shape_source& ss: src.shapes)
+            ss.data.bvh_data = data->shared_shapes[ss.mesh].bvh->get_bvh_data();
+        write_cooked_value(cooked_data, src.shapes);
+
+        // Written under a temporary name first, so that concurrent loads of
+        // the same file never see a partially written cache. The cache is
+        // only an optimization, so failing to write it is not an error.
+        std::filesystem::path cooked_path =
+            std::filesystem::path(opt.cooked_cache_dir)/cooked_name;
+        std::filesystem::path tmp_path = cooked_path;
+        tmp_path += "." + std::to_string(std::random_device()());
+        std::error_code err;
+        std::filesystem::create_directories(opt.cooked_cache_dir, err);
+        if(
+            err ||
+            !try_write_binary_file(tmp_path.string(), cooked_data.data(), cooked_data.size())
+        ){
+            RB_LOG("Unable to write cooked data for ", f.get_name());
+        }
+        else
+        {
+            std::filesystem::rename(tmp_path, cooked_path, err);
+            if(err)
+            {
+                RB_LOG("Unable to write cooked data for ", f.get_name());
+                std::filesystem::remove(tmp_path, err);
+            }
+        }
     }
 
     // Add collision shapes
@@ -1695,6 +2712,7 @@ void gltf_data::load_resources(
         if(!pctx) continue;
 
         tinygltf::Node& node = gltf_model.nodes[i];
+        if(node.mesh < 0) continue;
         //if(!node.extensions.count("RB_engine_data"))
         //    continue;
 
@@ -1713,8 +2731,6 @@ void gltf_data::load_resources(
             RB_PANIC("Cannot create collision shape; missing bounding box!");
 
         shape_assets& sa = data->shared_shapes[mesh_id];
-        if(!sa.bvh)
-            sa.bvh.reset(create_mesh_shape(pctx, gltf_model, mesh, params, true));
         shape = new phys::shape(*sa.bvh, params);
 
         data->shapes.emplace_back(shape);
@@ -1723,88 +2739,71 @@ void gltf_data::load_resources(
     }
 
     // Add animations
-    for(tinygltf::Animation& anim: gltf_model.animations)
+    for(animation_channel_source& cs: src.animation_channels)
     {
-        for(tinygltf::AnimationChannel& chan: anim.channels)
-        {
-            rigid_animation* ran = nullptr;
-            variable_animation<std::vector<float>>* mtan = nullptr;
-
-            if(chan.target_path == "weights")
-            { // Morph target animation
-                auto it = meta.morph_target_animations.find(chan.target_node);
-                if(it == meta.morph_target_animations.end())
-                    it = meta.morph_target_animations.emplace(
-                        chan.target_node,
-                        data->morph_target_animation_pools.emplace_back(
-                            new mesh::animation_pool()
-                        ).get()
-                    ).first;
-                mtan = &(*it->second)[anim.name];
-            }
-            else
-            { // Rigid animation
-                auto it = meta.rigid_animations.find(chan.target_node);
-                if(it == meta.rigid_animations.end())
-                    it = meta.rigid_animations.emplace(
-                        chan.target_node,
-                        data->rigid_animation_pools.emplace_back(
-                            new rigid_animation_pool()
-                        ).get()
-                    ).first;
-                ran = &(*it->second)[anim.name];
-            }
-            tinygltf::AnimationSampler& sampler = anim.samplers[chan.sampler];
-
-            interpolation interp = LINEAR;
-            if(sampler.interpolation == "LINEAR") interp = LINEAR;
-            else if(sampler.interpolation == "STEP") interp = STEP;
-            else if(sampler.interpolation == "CUBICSPLINE")
-                interp = CUBICSPLINE;
-
-            if(chan.target_path == "translation")
-                ran->set_position(
-                    interp,
-                    read_animation_accessors<vec3>(
-                        gltf_model, sampler.input, sampler.output,
-                        interp == CUBICSPLINE
-                    )
-                );
-            else if(chan.target_path == "rotation")
-                ran->set_orientation(
-                    interp,
-                    read_animation_accessors<quat>(
-                        gltf_model, sampler.input, sampler.output,
-                        interp == CUBICSPLINE
-                    )
-                );
-            else if(chan.target_path == "scale")
-                ran->set_scaling(
-                    interp,
-                    read_animation_accessors<vec3>(
-                        gltf_model, sampler.input, sampler.output,
-                        interp == CUBICSPLINE
-                    )
-                );
-            else if(chan.target_path == "weights")
-                *mtan = variable_animation(
-                    interp,
-                    read_animation_accessors_vector<float>(
-                        gltf_model, sampler.input, sampler.output,
-                        interp == CUBICSPLINE
-                    )
-                );
-            // Unknown target type (probably weights for morph targets)
-            else continue;
+        rigid_animation* ran = nullptr;
+        variable_animation<std::vector<float>>* mtan = nullptr;
+
+        if(cs.target_path == "weights")
+        { // Morph target animation
+            auto it = meta.morph_target_animations.find(cs.target_node);
+            if(it == meta.morph_target_animations.end())
+                it = meta.morph_target_animations.emplace(
+                    cs.target_node,
+                    data->morph_target_animation_pools.emplace_back(
+                        new mesh::animation_pool()
+                    ).get()
+                ).first;
+            mtan = &(*it->second)[cs.animation];
+        }
+        else
+        { // Rigid animation
+            auto it = meta.rigid_animations.find(cs.target_node);
+            if(it == meta.rigid_animations.end())
+                it = meta.rigid_animations.emplace(
+                    cs.target_node,
+                    data->rigid_animation_pools.emplace_back(
+                        new rigid_animation_pool()
+                    ).get()
+                ).first;
+            ran = &(*it->second)[cs.animation];
         }
+
+        bool expect_tangents = cs.interp == CUBICSPLINE;
+        if(cs.target_path == "translation")
+            ran->set_position(
+                cs.interp,
+                build_animation_samples(
+                    cs.timestamps, cs.vec3_data, expect_tangents
+                )
+            );
+        else if(cs.target_path == "rotation")
+            ran->set_orientation(
+                cs.interp,
+                build_animation_samples(
+                    cs.timestamps, cs.quat_data, expect_tangents
+                )
+            );
+        else if(cs.target_path == "scale")
+            ran->set_scaling(
+                cs.interp,
+                build_animation_samples(
+                    cs.timestamps, cs.vec3_data, expect_tangents
+                )
+            );
+        else if(cs.target_path == "weights")
+            *mtan = variable_animation(
+                cs.interp,
+                build_animation_samples_vector(
+                    cs.timestamps, cs.float_data, expect_tangents
+                )
+            );
     }
 
     // Add skins and mark joint nodes
-    for(tinygltf::Skin& skin: gltf_model.skins)
+    for(skin_source& skin: src.skins)
     {
-        std::vector<mat4> inverse_bind_matrices = read_accessor<mat4>(
-            gltf_model, skin.inverseBindMatrices
-        );
+        std::vector<mat4>& inverse_bind_matrices = skin.inverse_bind_matrices;
 
         if(inverse_bind_matrices.size() != skin.joints.size())
         {
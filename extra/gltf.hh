@@ -64,6 +64,34 @@ public:
         // animations or dynamic colliders. Otherwise, only static colliders
         // get marked as static.
         bool aggressive_static = false;
+
+        // If set, everything read from the file is cooked into this
+        // directory on first load: the node hierarchy, materials, encoded
+        // images, animations, skins, vertex data with generated attributes
+        // and the BVHs of collision shapes. Later loads of the same file with
+        // the same options read that instead of parsing the file. The cache
+        // is invalidated when the size of the main file or its external
+        // buffers changes, or when their modification time and contents
+        // both change.
+        std::string cooked_cache_dir = "";
+
+        // Deduplicates vertices and reorders primitives for vertex cache and
+        // fetch locality. optimize_overdraw additionally sorts triangle
+        // clusters to reduce overdraw, but can slightly hurt cache locality.
+        bool optimize_meshes = false;
+        bool optimize_overdraw = false;
+
+        // Uploads packed vertex attributes alongside the full-precision ones,
+        // which the forward stages use to cut vertex fetch bandwidth. The
+        // full-precision ones are still needed for ray tracing and
+        // animation, so this uses more memory, not less. Animated primitives
+        // are always drawn with full precision.
+        bool pack_vertices = false;
+
+        // Splits primitives into meshlets, which meshlet_culling_stage can
+        // cull per view for multiview rendering. Skipped for animated
+        // primitives.
+        bool build_meshlets = false;
     };
 
     // By default, everything is rendered. Use the 'foreach' function in order
@@ -0,0 +1,78 @@
+#ifndef RAYBASE_GFX_CLUSTERING_FUSED_GLSL
+#define RAYBASE_GFX_CLUSTERING_FUSED_GLSL
+#include "clustering.glsl"
+
+// Computes item ranges and the slice bitmasks in one pass. The including
+// shader must enable GL_EXT_scalar_block_layout and define
+// `vec2 get_item_axis_range(uint item_index, uint axis_index)` before
+// including this file. Each workgroup handles 128 items (4 mask words) of one
+// axis, given by gl_WorkGroupID.z, for SLICE_BLOCKS_PER_WORKGROUP blocks of 32
+// slices. The ranges never leave shared memory, and each workgroup only
+// computes them for its own axis.
+
+layout(binding = 1, set = 0) buffer cluster_buffer
+{
+    uint slices[];
+} cluster_slices;
+
+layout(local_size_x = 32, local_size_y = 4) in;
+
+layout(push_constant, scalar) uniform push_constant_buffer
+{
+    vec4 cluster_min;
+    vec4 cluster_slice;
+    uint cluster_axis_stride;
+    uint cluster_size;
+    uint item_count;
+} pc;
+
+// Must match FUSED_CLUSTERING_SLICE_BLOCKS in clustering_stage.cc.
+const uint SLICE_BLOCKS_PER_WORKGROUP = 8;
+
+shared uvec2 ranges[128];
+
+const uint BITS_IN_MASK = 32;
+
+uvec2 range_to_slices(vec2 range, uint axis_index)
+{
+    range = (range - pc.cluster_min[axis_index])/pc.cluster_slice[axis_index];
+    uvec2 urange = max(uvec2(floor(range)), uvec2(0));
+    return urange & 0xFFFFu;
+}
+
+void main()
+{
+    uint axis = gl_WorkGroupID.z;
+    uint local_index = gl_LocalInvocationID.y * BITS_IN_MASK + gl_LocalInvocationID.x;
+    uint item_index = gl_WorkGroupID.y * gl_WorkGroupSize.y * BITS_IN_MASK + local_index;
+
+    ranges[local_index] = item_index < pc.item_count ?
+        range_to_slices(get_item_axis_range(item_index, axis), axis) :
+        uvec2(0xFFFF, 0x0000);
+
+    barrier();
+
+    uint slice_words = gl_NumWorkGroups.y * gl_WorkGroupSize.y;
+    uint first_slice =
+        gl_WorkGroupID.x * SLICE_BLOCKS_PER_WORKGROUP * BITS_IN_MASK + gl_LocalInvocationID.x;
+    for(uint block = 0; block < SLICE_BLOCKS_PER_WORKGROUP; ++block)
+    {
+        uint slice = first_slice + block * BITS_IN_MASK;
+        if(slice >= pc.cluster_size)
+            break;
+
+        uint mask = 0;
+        for(int i = 0; i < BITS_IN_MASK; ++i)
+        {
+            uvec2 range = ranges[gl_LocalInvocationID.y * BITS_IN_MASK + i];
+            if(slice >= range.x && slice <= range.y)
+                mask |= 1 << i;
+        }
+
+        cluster_slices.slices[
+            axis * pc.cluster_axis_stride + slice * slice_words + gl_GlobalInvocationID.y
+        ] = mask;
+    }
+}
+
+#endif
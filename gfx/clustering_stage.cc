@@ -8,10 +8,17 @@
 #include "clustering_hierarchy.comp.h"
 #include "decal_order.comp.h"
 #include "decal_ranges.comp.h"
+#include "light_clustering_fused.comp.h"
+#include "decal_clustering_fused.comp.h"
+#include "core/sort.hh"
+#include <random>
+#include <cstring>
 
 #define MORTON_BITS_PER_AXIS 8
 #define CLUSTER_AXIS_COUNT 3
 #define CLUSTER_HIERARCHY_THRESHOLD 1024
+// Number of 32-slice blocks per workgroup in clustering_fused.glsl.
+#define FUSED_CLUSTERING_SLICE_BLOCKS 8
 
 namespace
 {
@@ -38,6 +45,15 @@ struct clustering_push_constant_buffer
     uint32_t axis;
 };
 
+struct fused_clustering_push_constant_buffer
+{
+    pvec4 cluster_min;
+    pvec4 cluster_slice;
+    uint32_t cluster_axis_stride;
+    uint32_t cluster_size;
+    uint32_t item_count;
+};
+
 struct hierarchy_push_constant_buffer
 {
     uint32_t cluster_axis_offset;
@@ -93,6 +109,95 @@ uint32_t get_total_slice_count(uint32_t resolution, uint32_t scale = 1)
     return (resolution / scale) * CLUSTER_AXIS_COUNT;
 }
 
+void add_clustering_bindings(descriptor_set& set)
+{
+    set.add("cluster_ranges", {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
+    set.add("cluster_slices", {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
+    set.add("hierarchy_slices", {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
+    set.add("sorting_order", {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
+    set.add("items", {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
+    set.add(
+        "metadata", {5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr},
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+    );
+}
+
+// Runs the ballot variant of clustering.comp on random ranges and compares
+// its bitmasks against ones computed on the CPU. Returns false on mismatch.
+bool check_subgroup_ballot(device& dev, compute_pipeline& ballot_pipeline)
+{
+    constexpr uint32_t max_items = 1024;
+    constexpr uint32_t item_count = 1000; // Leaves a partial last row.
+    constexpr uint32_t cluster_resolution = 256;
+
+    descriptor_set set(dev);
+    add_clustering_bindings(set);
+    set.reset(1);
+
+    std::mt19937 rng(0);
+    std::vector<uint32_t> ranges(max_items);
+    for(uint32_t& range: ranges)
+    {
+        uint32_t first = rng() % cluster_resolution;
+        uint32_t last = std::min(first + uint32_t(rng() % 64), cluster_resolution - 1);
+        if(rng() % 8 == 0)
+        { // Empty range, like the ones of culled items.
+            first = 0xFFFF;
+            last = 0;
+        }
+        range = first | (last << 16);
+    }
+
+    uint32_t uvec4_slice_count = get_cluster_slice_size(max_items, 0)/sizeof(uvec4);
+    uint32_t slice_words = uvec4_slice_count * 4;
+    std::vector<uint32_t> expected(slice_words * cluster_resolution, 0);
+    for(uint32_t item = 0; item < item_count; ++item)
+    {
+        uint32_t first = ranges[item] & 0xFFFF;
+        uint32_t last = ranges[item] >> 16;
+        for(uint32_t slice = first; slice <= last && slice < cluster_resolution; ++slice)
+            expected[slice * slice_words + item / 32] |= 1u << (item % 32);
+    }
+
+    event e;
+    vkres<VkBuffer> range_buffer = upload_buffer(
+        dev, e, ranges.size() * sizeof(uint32_t), ranges.data(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+    );
+    e.wait(dev);
+
+    size_t mask_bytes = expected.size() * sizeof(uint32_t);
+    vkres<VkBuffer> mask_buffer = create_gpu_buffer(
+        dev, mask_bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+    );
+    vkres<VkBuffer> readback_buffer = create_readback_buffer(dev, mask_bytes);
+
+    set.set_buffer(0, "cluster_ranges", (VkBuffer)range_buffer);
+    set.set_buffer(0, "cluster_slices", (VkBuffer)mask_buffer);
+
+    clustering_push_constant_buffer pc;
+    pc.range_axis_offset = 0;
+    pc.cluster_axis_offset = 0;
+    pc.cluster_size = cluster_resolution;
+    pc.item_count = item_count;
+    pc.axis = 0;
+
+    vkres<VkCommandBuffer> cmd = begin_command_buffer(dev);
+    ballot_pipeline.bind(cmd);
+    ballot_pipeline.set_descriptors(cmd, set, 0, 0);
+    ballot_pipeline.push_constants(cmd, &pc);
+    ballot_pipeline.dispatch(cmd, uvec3((cluster_resolution + 31u)/32u, uvec4_slice_count, 1));
+    buffer_barrier(cmd, mask_buffer);
+    VkBufferCopy region = {0, 0, mask_bytes};
+    vkCmdCopyBuffer(cmd, mask_buffer, readback_buffer, 1, &region);
+    end_command_buffer(dev, cmd).wait(dev);
+
+    uint32_t* masks = nullptr;
+    vmaMapMemory(dev.allocator, readback_buffer.get_allocation(), (void**)&masks);
+    bool match = memcmp(masks, expected.data(), mask_bytes) == 0;
+    vmaUnmapMemory(dev.allocator, readback_buffer.get_allocation());
+    return match;
+}
+
 void run_clustering(
     VkCommandBuffer cmd,
     uint32_t item_count,
@@ -106,6 +211,7 @@ void run_clustering(
     compute_pipeline& range_pipeline,
     compute_pipeline& clustering_pipeline,
     compute_pipeline& hierarchy_pipeline,
+    compute_pipeline* fused_pipeline,
     const descriptor_set& clustering_data_set,
     const descriptor_set& scene_data_set,
     uint32_t clustering_data_set_index,
@@ -113,6 +219,7 @@ void run_clustering(
     radix_sort* sorter,
     VkBuffer unsorted_items,
     VkBuffer sort_order,
+    VkBuffer presorted_order,
     VkBuffer sorted_items,
     VkBuffer unsorted_metadata,
     VkBuffer sorted_metadata,
@@ -126,7 +233,22 @@ void run_clustering(
     if(item_count == 0)
         return;
 
-    if(sort_bits > 0)
+    if(sort_bits > 0 && presorted_order)
+    {// The order is already known, so just place the items accordingly.
+        if(sort_timer) sort_timer->start(cmd, frame_index);
+        sorter->place(
+            cmd, unsorted_items, presorted_order, sorted_items,
+            item_size, item_count
+        );
+        if(unsorted_metadata)
+        {
+            sorter->resort(cmd, unsorted_metadata, sorted_metadata, metadata_size, item_count);
+        }
+        if(sort_mapping)
+            sorter->get_sort_index(cmd, sort_mapping, item_count);
+        if(sort_timer) sort_timer->stop(cmd, frame_index);
+    }
+    else if(sort_bits > 0)
     {// Calculate sorting for all items.
         if(sort_timer) sort_timer->start(cmd, frame_index);
         order_pipeline.bind(cmd);
@@ -162,6 +284,53 @@ void run_clustering(
         if(sort_timer) sort_timer->stop(cmd, frame_index);
     }
 
+    // Barrier for cluster
+    VkMemoryBarrier2KHR barrier = {
+        VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR,
+        nullptr,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+    };
+    VkDependencyInfoKHR deps = {
+        VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR, nullptr, 0,
+        1, &barrier, 0, nullptr, 0, nullptr
+    };
+
+    if(fused_pipeline)
+    {// Ranges and bitmasks in one go, the ranges stay in shared memory.
+        if(bitmask_timer) bitmask_timer->start(cmd, frame_index);
+        fused_pipeline->bind(cmd);
+        fused_pipeline->set_descriptors(cmd, clustering_data_set, clustering_data_set_index, 0);
+        fused_pipeline->set_descriptors(cmd, scene_data_set, 0, 1);
+
+        uint32_t uvec4_slice_count = get_cluster_slice_size(max_items, 0)/sizeof(uvec4);
+
+        fused_clustering_push_constant_buffer pc;
+        for(int i = 0; i < CLUSTER_AXIS_COUNT; ++i)
+        {
+            vec2 bounds = vec2(cluster_bounds[0][i], cluster_bounds[1][i]);
+            pc.cluster_min[i] = bounds.x;
+            pc.cluster_slice[i] = (bounds.y - bounds.x) / cluster_resolution;
+        }
+        pc.cluster_axis_stride = uvec4_slice_count * 4 * cluster_resolution;
+        pc.cluster_size = cluster_resolution;
+        pc.item_count = item_count;
+        fused_pipeline->push_constants(cmd, &pc);
+        uint32_t slices_per_workgroup = 32u * FUSED_CLUSTERING_SLICE_BLOCKS;
+        fused_pipeline->dispatch(
+            cmd,
+            uvec3(
+                (cluster_resolution + slices_per_workgroup - 1)/slices_per_workgroup,
+                uvec4_slice_count,
+                CLUSTER_AXIS_COUNT
+            )
+        );
+        vkCmdPipelineBarrier2KHR(cmd, &deps);
+        if(bitmask_timer) bitmask_timer->stop(cmd, frame_index);
+    }
+    else
     {// Now, we calculate item ranges.
         if(range_timer) range_timer->start(cmd, frame_index);
         range_pipeline.bind(cmd);
@@ -185,44 +354,31 @@ void run_clustering(
             );
         }
         if(range_timer) range_timer->stop(cmd, frame_index);
-    }
 
-    if(bitmask_timer) bitmask_timer->start(cmd, frame_index);
-    // Barrier for cluster
-    VkMemoryBarrier2KHR barrier = {
-        VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR,
-        nullptr,
-        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
-        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
-        VK_ACCESS_2_SHADER_STORAGE_READ_BIT
-    };
-    VkDependencyInfoKHR deps = {
-        VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR, nullptr, 0,
-        1, &barrier, 0, nullptr, 0, nullptr
-    };
-    vkCmdPipelineBarrier2KHR(cmd, &deps);
+        if(bitmask_timer) bitmask_timer->start(cmd, frame_index);
+        vkCmdPipelineBarrier2KHR(cmd, &deps);
 
-    {// Now, we calculate the high-resolution primary cluster.
-        clustering_pipeline.bind(cmd);
-        clustering_pipeline.set_descriptors(cmd, clustering_data_set, clustering_data_set_index, 0);
+        {// Now, we calculate the high-resolution primary cluster.
+            clustering_pipeline.bind(cmd);
+            clustering_pipeline.set_descriptors(cmd, clustering_data_set, clustering_data_set_index, 0);
 
-        uint32_t uvec4_slice_count = get_cluster_slice_size(max_items, 0)/sizeof(uvec4);
+            uint32_t uvec4_slice_count = get_cluster_slice_size(max_items, 0)/sizeof(uvec4);
 
-        clustering_push_constant_buffer pc;
-        pc.item_count = item_count;
+            clustering_push_constant_buffer pc;
+            pc.item_count = item_count;
 
-        for(int i = 0; i < CLUSTER_AXIS_COUNT; ++i)
-        {
-            pc.axis = i;
-            pc.range_axis_offset = i * max_items;
-            pc.cluster_axis_offset = i * uvec4_slice_count * 4 * cluster_resolution;
-            pc.cluster_size = cluster_resolution;
-            clustering_pipeline.push_constants(cmd, &pc);
-            clustering_pipeline.dispatch(cmd, uvec3((cluster_resolution + 31u)/32u, uvec4_slice_count, 1));
+            for(int i = 0; i < CLUSTER_AXIS_COUNT; ++i)
+            {
+                pc.axis = i;
+                pc.range_axis_offset = i * max_items;
+                pc.cluster_axis_offset = i * uvec4_slice_count * 4 * cluster_resolution;
+                pc.cluster_size = cluster_resolution;
+                clustering_pipeline.push_constants(cmd, &pc);
+                clustering_pipeline.dispatch(cmd, uvec3((cluster_resolution + 31u)/32u, uvec4_slice_count, 1));
+            }
         }
+        if(bitmask_timer) bitmask_timer->stop(cmd, frame_index);
     }
-    if(bitmask_timer) bitmask_timer->stop(cmd, frame_index);
 
     if(max_items >= CLUSTER_HIERARCHY_THRESHOLD)
     { // Finally, we build the hierarchical bitmask from the exact cluster.
@@ -302,12 +458,20 @@ clustering_stage::clustering_stage(scene_stage& scene, const options& opt)
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_SRC_BIT
     )),
     sorted_decals(create_gpu_buffer(scene.get_device(), scene.unsorted_decals.get_size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)),
+    light_sort_keyvals(
+        scene.get_device(),
+        scene.opt.max_lights >= CLUSTER_HIERARCHY_THRESHOLD && opt.incremental_light_sort_threshold > 0.0f ?
+            sizeof(uvec2) * scene.opt.max_lights : 0,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+    ),
     light_morton_pipeline(scene.get_device()),
     light_range_pipeline(scene.get_device()),
     clustering_pipeline(scene.get_device()),
     hierarchy_pipeline(scene.get_device()),
     decal_order_pipeline(scene.get_device()),
     decal_range_pipeline(scene.get_device()),
+    light_fused_pipeline(scene.get_device()),
+    decal_fused_pipeline(scene.get_device()),
     clustering_data_set(scene.get_device())
 {
     if(scene.opt.max_lights >= CLUSTER_HIERARCHY_THRESHOLD || scene.opt.max_decals > 0)
@@ -319,15 +483,7 @@ clustering_stage::clustering_stage(scene_stage& scene, const options& opt)
         sort_order = sorter->create_keyval_buffer();
     }
 
-    clustering_data_set.add("cluster_ranges", {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
-    clustering_data_set.add("cluster_slices", {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
-    clustering_data_set.add("hierarchy_slices", {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
-    clustering_data_set.add("sorting_order", {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
-    clustering_data_set.add("items", {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr});
-    clustering_data_set.add(
-        "metadata", {5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr},
-        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
-    );
+    add_clustering_bindings(clustering_data_set);
     clustering_data_set.reset(3);
 
     // Light clustering data
@@ -363,11 +519,28 @@ clustering_stage::clustering_stage(scene_stage& scene, const options& opt)
         {clustering_data_set.get_layout(), scene.get_descriptor_set().get_layout()}
     );
 
+    const VkPhysicalDeviceSubgroupProperties& subgroup = scene.get_device().subgroup_properties;
+    bool use_ballot =
+        subgroup.subgroupSize >= 32 &&
+        (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroup.supportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT) &&
+        (subgroup.supportedOperations & VK_SUBGROUP_FEATURE_VOTE_BIT);
     clustering_pipeline.init(
-        clustering_comp_shader_binary,
+        shader_data(clustering_comp_shader_binary, {{0, use_ballot ? 1u : 0u}}),
         sizeof(clustering_push_constant_buffer),
         {clustering_data_set.get_layout()}
     );
+    // The ballot path relies on subgroup behaviour that drivers have gotten
+    // wrong before, so it's only kept if it matches a CPU reference.
+    if(use_ballot && !check_subgroup_ballot(scene.get_device(), clustering_pipeline))
+    {
+        RB_LOG("Subgroup ballot clustering gave wrong results, using shared memory instead");
+        clustering_pipeline.init(
+            shader_data(clustering_comp_shader_binary, {{0, 0u}}),
+            sizeof(clustering_push_constant_buffer),
+            {clustering_data_set.get_layout()}
+        );
+    }
 
     hierarchy_pipeline.init(
         clustering_hierarchy_comp_shader_binary,
@@ -387,6 +560,21 @@ clustering_stage::clustering_stage(scene_stage& scene, const options& opt)
         {clustering_data_set.get_layout(), scene.get_descriptor_set().get_layout()}
     );
 
+    if(opt.fused_clustering_max_items > 0)
+    {
+        light_fused_pipeline.init(
+            light_clustering_fused_comp_shader_binary,
+            sizeof(fused_clustering_push_constant_buffer),
+            {clustering_data_set.get_layout(), scene.get_descriptor_set().get_layout()}
+        );
+
+        decal_fused_pipeline.init(
+            decal_clustering_fused_comp_shader_binary,
+            sizeof(fused_clustering_push_constant_buffer),
+            {clustering_data_set.get_layout(), scene.get_descriptor_set().get_layout()}
+        );
+    }
+
     scene.cluster_provider = this;
 }
 
@@ -423,21 +611,50 @@ scene_stage* clustering_stage::get_scene_data() const
 
 void clustering_stage::update_buffers(uint32_t frame_index)
 {
-    clear_commands();
-    VkCommandBuffer cmd = compute_commands(true);
+    last_update_frame = dev->get_frame_counter();
+
+    // The sort order is uploaded from the staging buffer of this frame, so it
+    // must be refreshed even if the commands are reused.
+    bool presorted = scene_data->current_scene &&
+        light_sort_keyvals.get_size() != 0 && scene_data->point_light_count != 0;
+    if(presorted)
+        update_light_sort_order(frame_index);
+
+    // Everything else the commands depend on. Bounds only stay the same when
+    // lights and decals don't move, which is when reuse pays off the most.
+    size_t state_hash = 0;
+    hash_combine(state_hash, scene_data->current_scene);
+    hash_combine(state_hash, scene_data->point_light_count);
+    hash_combine(state_hash, scene_data->decal_count);
+    hash_combine(state_hash, scene_data->light_bounds[0]);
+    hash_combine(state_hash, scene_data->light_bounds[1]);
+    hash_combine(state_hash, scene_data->decal_bounds[0]);
+    hash_combine(state_hash, scene_data->decal_bounds[1]);
+    hash_combine(state_hash, presorted);
+    hash_combine(state_hash, scene_data->get_descriptor_set().get_version());
+    hash_combine(state_hash, clustering_data_set.get_version());
+    if(reuse_commands(frame_index, state_hash))
+        return;
+
+    VkCommandBuffer cmd = compute_commands();
     stage_timer.start(cmd, frame_index);
     if(scene_data->current_scene)
     {
-        run_light_clustering(cmd, frame_index);
+        run_light_clustering(cmd, frame_index, presorted);
         run_decal_clustering(cmd, frame_index);
     }
     stage_timer.stop(cmd, frame_index);
     use_compute_commands(cmd, frame_index);
-    last_update_frame = dev->get_frame_counter();
 }
 
-void clustering_stage::run_light_clustering(VkCommandBuffer cmd, uint32_t frame_index)
-{
+void clustering_stage::run_light_clustering(
+    VkCommandBuffer cmd,
+    uint32_t frame_index,
+    bool presorted
+){
+    if(presorted)
+        upload(cmd, {&light_sort_keyvals}, frame_index);
+
     run_clustering(
         cmd,
         scene_data->point_light_count,
@@ -451,6 +668,9 @@ void clustering_stage::run_light_clustering(VkCommandBuffer cmd, uint32_t frame_
         light_range_pipeline,
         clustering_pipeline,
         hierarchy_pipeline,
+        opt.fused_clustering_max_items > 0 &&
+        scene_data->point_light_count <= opt.fused_clustering_max_items ?
+            &light_fused_pipeline : nullptr,
         clustering_data_set,
         scene_data->get_descriptor_set(),
         frame_index & 1,
@@ -458,6 +678,7 @@ void clustering_stage::run_light_clustering(VkCommandBuffer cmd, uint32_t frame_
         (sorter ? &sorter.value() : nullptr),
         scene_data->unsorted_point_lights,
         sort_order,
+        presorted ? (VkBuffer)light_sort_keyvals : VK_NULL_HANDLE,
         sorted_point_lights,
         VK_NULL_HANDLE,
         VK_NULL_HANDLE,
@@ -485,6 +706,9 @@ void clustering_stage::run_decal_clustering(VkCommandBuffer cmd, uint32_t frame_
         decal_range_pipeline,
         clustering_pipeline,
         hierarchy_pipeline,
+        opt.fused_clustering_max_items > 0 &&
+        scene_data->decal_count <= opt.fused_clustering_max_items ?
+            &decal_fused_pipeline : nullptr,
         clustering_data_set,
         scene_data->get_descriptor_set(),
         2,
@@ -492,6 +716,7 @@ void clustering_stage::run_decal_clustering(VkCommandBuffer cmd, uint32_t frame_
         (sorter ? &sorter.value() : nullptr),
         scene_data->unsorted_decals,
         sort_order,
+        VK_NULL_HANDLE,
         sorted_decals,
         VK_NULL_HANDLE,
         VK_NULL_HANDLE,
@@ -504,5 +729,75 @@ void clustering_stage::run_decal_clustering(VkCommandBuffer cmd, uint32_t frame_
     );
 }
 
+void clustering_stage::update_light_sort_order(uint32_t frame_index)
+{
+    uint32_t count = scene_data->point_light_count;
+    uint32_t prev_count = light_sort_keys.size();
+    const vec3* bounds = scene_data->light_bounds;
+    vec3 bounds_step = (bounds[1] - bounds[0]) / float(1 << MORTON_BITS_PER_AXIS);
+    uint32_t morton_shift = 32 - MORTON_BITS_PER_AXIS * CLUSTER_AXIS_COUNT;
+
+    // Same keys as light_morton.comp.
+    std::vector<uint32_t> keys(count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        vec3 pos = scene_data->point_light_positions[i];
+        uvec3 coord = min(
+            uvec3((pos - bounds[0]) / bounds_step),
+            uvec3((1u<<(32/CLUSTER_AXIS_COUNT))-1u)
+        );
+        keys[i] = morton_encode(coord) << morton_shift;
+    }
+
+    // Lights are tracked by their unsorted index. A light that keeps its
+    // index and key also keeps its place in the previous order, regardless of
+    // whether it's truly the same light.
+    std::vector<bool> changed(count, true);
+    std::vector<uint32_t> delta;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(i < prev_count && keys[i] == light_sort_keys[i])
+            changed[i] = false;
+        else delta.push_back(i);
+    }
+
+    if(prev_count == 0 || delta.size() > opt.incremental_light_sort_threshold * count)
+    { // Too many changes, just sort everything.
+        light_sort_order.resize(count);
+        radix_argsort(count, keys.data(), light_sort_order.data(),
+            [](uint32_t key){ return key; });
+    }
+    else
+    { // Merge the re-sorted delta into the surviving part of the old order.
+        std::vector<uint32_t> base;
+        base.reserve(count);
+        for(uint32_t i: light_sort_order)
+        {
+            if(i < count && !changed[i])
+                base.push_back(i);
+        }
+
+        std::stable_sort(delta.begin(), delta.end(), [&](uint32_t a, uint32_t b){
+            return keys[a] < keys[b];
+        });
+
+        light_sort_order.resize(count);
+        std::merge(
+            base.begin(), base.end(),
+            delta.begin(), delta.end(),
+            light_sort_order.begin(),
+            [&](uint32_t a, uint32_t b){ return keys[a] < keys[b]; }
+        );
+    }
+    light_sort_keys = std::move(keys);
+
+    light_sort_keyvals.update<uvec2>(frame_index, [&](uvec2* data){
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t index = light_sort_order[i];
+            data[i] = uvec2(index, light_sort_keys[index]);
+        }
+    });
 }
 
+}
@@ -23,6 +23,23 @@ public:
         // cluster, so parameters can be adjusted separately. The same caveats
         // apply.
         uint32_t decal_cluster_resolution = 512;
+
+        // When lights are sorted (max_lights >= 1024), the sorting order can
+        // be maintained on the CPU across frames instead of re-sorting all
+        // lights on the GPU. Only lights whose sorting key changed are sorted
+        // and merged into the previous order. If more than this fraction of
+        // lights changed, all of them are sorted from scratch. Zero disables
+        // this and always uses the full GPU sort.
+        float incremental_light_sort_threshold = 0.0f;
+
+        // With at most this many lights or decals, ranges and bitmasks are
+        // computed by a single fused dispatch instead of separate range and
+        // bitmask passes. This skips the range buffer round-trip and most of
+        // the dispatch overhead, which dominate with small item counts. The
+        // fused dispatch is timed as "bitmask" only, so benchmark results are
+        // not directly comparable with the separate passes. Zero, the
+        // default, always uses the separate passes.
+        uint32_t fused_clustering_max_items = 0;
     };
 
     clustering_stage(scene_stage& s, const options& opt);
@@ -41,8 +58,13 @@ protected:
 private:
     friend class scene_stage;
 
-    void run_light_clustering(VkCommandBuffer cmd, uint32_t frame_index);
+    void run_light_clustering(
+        VkCommandBuffer cmd,
+        uint32_t frame_index,
+        bool presorted
+    );
     void run_decal_clustering(VkCommandBuffer cmd, uint32_t frame_index);
+    void update_light_sort_order(uint32_t frame_index);
 
     options opt;
     scene_stage* scene_data;
@@ -64,12 +86,19 @@ private:
     vkres<VkBuffer> sorted_point_lights;
     vkres<VkBuffer> sorted_decals;
 
+    // Incremental light sorting state, by unsorted light index.
+    std::vector<uint32_t> light_sort_keys;
+    std::vector<uint32_t> light_sort_order;
+    gpu_buffer light_sort_keyvals;
+
     compute_pipeline light_morton_pipeline;
     compute_pipeline light_range_pipeline;
     compute_pipeline clustering_pipeline;
     compute_pipeline hierarchy_pipeline;
     compute_pipeline decal_order_pipeline;
     compute_pipeline decal_range_pipeline;
+    compute_pipeline light_fused_pipeline;
+    compute_pipeline decal_fused_pipeline;
 
     descriptor_set clustering_data_set;
 };
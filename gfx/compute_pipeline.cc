@@ -13,6 +13,19 @@ void compute_pipeline::init(
     shader_data compute,
     size_t push_constant_size,
     argvec<VkDescriptorSetLayout> sets
+){
+    compile([
+        this, compute, push_constant_size,
+        sets = std::vector<VkDescriptorSetLayout>(sets.begin(), sets.end())
+    ](){
+        create(compute, push_constant_size, sets);
+    });
+}
+
+void compute_pipeline::create(
+    const shader_data& compute,
+    size_t push_constant_size,
+    argvec<VkDescriptorSetLayout> sets
 ){
     vkres<VkShaderModule> shader = load_shader(compute);
     specialization_info_wrapper compute_spec(compute.specialization);
@@ -19,6 +19,13 @@ public:
     );
 
     void dispatch(VkCommandBuffer buf, uvec3 work_size);
+
+private:
+    void create(
+        const shader_data& compute,
+        size_t push_constant_size,
+        argvec<VkDescriptorSetLayout> sets
+    );
 };
 
 }
@@ -14,4 +14,35 @@ struct decal
     material_spec material;
 };
 
+// Extent of the decal's bounding box along the given world axis.
+vec2 decal_axis_range(decal d, uint axis_index)
+{
+    mat4 obb_to_world = inverse(transpose(d.world_to_obb));
+    float xrange = obb_to_world[0][axis_index];
+    float yrange = obb_to_world[1][axis_index];
+    float zrange = obb_to_world[2][axis_index];
+    float pos = obb_to_world[3][axis_index];
+
+    float values[8] = float[](
+        pos + xrange - yrange + zrange,
+        pos + xrange - yrange - zrange,
+        pos + xrange + yrange + zrange,
+        pos + xrange + yrange - zrange,
+        pos - xrange - yrange + zrange,
+        pos - xrange - yrange - zrange,
+        pos - xrange + yrange + zrange,
+        pos - xrange + yrange - zrange
+    );
+
+    float decal_min = min(
+        min(min(values[0], values[1]), min(values[2], values[3])),
+        min(min(values[4], values[5]), min(values[6], values[7]))
+    );
+    float decal_max = max(
+        max(max(values[0], values[1]), max(values[2], values[3])),
+        max(max(values[4], values[5]), max(values[6], values[7]))
+    );
+    return vec2(decal_min, decal_max);
+}
+
 #endif
@@ -224,6 +224,7 @@ void descriptor_set::reset(uint32_t count)
             dev->gc.depend(*layout, set);
         }
     }
+    version++;
 }
 
 void descriptor_set::set_image(
@@ -280,6 +281,7 @@ void descriptor_set::set_image(
         image_infos.get(), nullptr, nullptr
     };
     vkUpdateDescriptorSets(dev->logical_device, 1, &write, 0,  nullptr);
+    version++;
 
     dev->gc.depend_many(views.make_void_ptr().clip(), alternatives[index]);
     dev->gc.depend_many(samplers.make_void_ptr().clip(), alternatives[index]);
@@ -353,6 +355,7 @@ void descriptor_set::set_buffer(
             alternatives[index]
         );
     }
+    version++;
 }
 
 void descriptor_set::set_acceleration_structure(
@@ -382,9 +385,15 @@ void descriptor_set::set_acceleration_structure(
         nullptr, nullptr, nullptr
     };
     vkUpdateDescriptorSets(dev->logical_device, 1, &write, 0,  nullptr);
+    version++;
     dev->gc.depend(tlas, alternatives[index]);
 }
 
+uint64_t descriptor_set::get_version() const
+{
+    return version;
+}
+
 void descriptor_set::bind(
     VkCommandBuffer buf,
     VkPipelineLayout pipeline_layout,
@@ -109,9 +109,15 @@ public:
         uint32_t set_index
     ) const;
 
+    // Changes whenever the sets are reset or any descriptor is written.
+    // Recorded command buffers that bind this set are only valid as long as
+    // the version stays the same.
+    uint64_t get_version() const;
+
 protected:
     std::vector<VkDescriptorSet> alternatives;
     vkres<VkDescriptorPool> pool;
+    uint64_t version = 0;
 };
 
 class push_descriptor_set: public descriptor_set_layout
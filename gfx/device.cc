@@ -3,7 +3,9 @@
 #include "vulkan_helpers.hh"
 #include "core/stack_allocator.hh"
 #include "core/error.hh"
+#include "core/io.hh"
 #include <string>
+#include <cstring>
 #ifdef RAYBASE_USE_SDL2
 #include <SDL_vulkan.h>
 #endif
@@ -335,6 +337,74 @@ void device::open()
     init_timing();
 }
 
+bool device::load_pipeline_cache(const std::string& path)
+{
+    RB_CHECK(!is_open(), "The device must be open to load a pipeline cache");
+
+    std::error_code err;
+    if(!fs::exists(path, err))
+        return false;
+    std::string data = read_text_file(path);
+
+    // Some drivers don't reject caches from other devices properly, so the
+    // header is checked here.
+    VkPipelineCacheHeaderVersionOne header;
+    if(data.size() < sizeof(header))
+        return false;
+    memcpy(&header, data.data(), sizeof(header));
+    const VkPhysicalDeviceProperties& props = physical_device_props.properties;
+    if(
+        header.headerSize < sizeof(header) ||
+        header.headerSize > data.size() ||
+        header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        header.vendorID != props.vendorID ||
+        header.deviceID != props.deviceID ||
+        memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0
+    ) return false;
+
+    VkPipelineCacheCreateInfo loaded_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        nullptr,
+        0,
+        data.size(),
+        data.data()
+    };
+    VkPipelineCache loaded;
+    if(vkCreatePipelineCache(logical_device, &loaded_info, nullptr, &loaded) != VK_SUCCESS)
+        return false;
+    vkMergePipelineCaches(logical_device, pp_cache, 1, &loaded);
+    vkDestroyPipelineCache(logical_device, loaded, nullptr);
+    return true;
+}
+
+bool device::save_pipeline_cache(const std::string& path) const
+{
+    RB_CHECK(!is_open(), "The device must be open to save a pipeline cache");
+
+    size_t size = 0;
+    vkGetPipelineCacheData(logical_device, pp_cache, &size, nullptr);
+    std::vector<uint8_t> data(size);
+    vkGetPipelineCacheData(logical_device, pp_cache, &size, data.data());
+
+    // Written under a temporary name first, so that an interrupted write
+    // never leaves a broken cache behind.
+    std::string tmp_path = path + ".tmp";
+    std::error_code err;
+    if(!try_write_binary_file(tmp_path, data.data(), size))
+    {
+        RB_LOG("Unable to write pipeline cache to ", tmp_path);
+        return false;
+    }
+    fs::rename(tmp_path, path, err);
+    if(err)
+    {
+        RB_LOG("Unable to write pipeline cache to ", path, ": ", err.message());
+        fs::remove(tmp_path, err);
+        return false;
+    }
+    return true;
+}
+
 bool device::is_open() const
 {
     return logical_device != VK_NULL_HANDLE;
@@ -650,15 +720,17 @@ void device::add_command_buffer_garbage(VkCommandPool pool, VkCommandBuffer buf)
     command_pool_garbage[pool].push_back(buf);
 }
 
-VkCommandBuffer device::allocate_command_buffer(VkCommandPool pool)
-{
+VkCommandBuffer device::allocate_command_buffer(
+    VkCommandPool pool,
+    VkCommandBufferLevel level
+){
     release_pool_garbage(pool);
 
     VkCommandBufferAllocateInfo command_buffer_alloc_info = {
         VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         nullptr,
         pool,
-        VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        level,
         1
     };
     VkCommandBuffer buf;
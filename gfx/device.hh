@@ -111,7 +111,18 @@ public:
 
     // You should allocate your command buffers with this call, which makes sure
     // that used command buffers get released properly.
-    VkCommandBuffer allocate_command_buffer(VkCommandPool pool);
+    VkCommandBuffer allocate_command_buffer(
+        VkCommandPool pool,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+    );
+
+    // Pipelines compile much faster when the cache is kept on disk between
+    // runs. Loading merges the file into the current cache and returns false
+    // if it is missing or was made for a different device or driver. Saving
+    // is best-effort: failures are logged and reported by returning false.
+    // The device must be open.
+    bool load_pipeline_cache(const std::string& path);
+    bool save_pipeline_cache(const std::string& path) const;
 
     bool present(VkPresentInfoKHR& present);
     VkQueue get_graphics_queue(bool async_load = false);
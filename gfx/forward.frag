@@ -19,7 +19,7 @@ layout(location = 0) out vec4 out_color;
 
 void main()
 {
-    instance inst = instances.array[pc.instance_index];
+    instance inst = instances.array[in_instance_index];
 
     vertex_data vd;
     material mat;
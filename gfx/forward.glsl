@@ -29,6 +29,7 @@ layout(location = 2) in vec3 in_tangent;
 layout(location = 3) in vec3 in_bitangent;
 layout(location = 4) in vec2 in_uv;
 layout(location = 5) in vec2 in_lightmap_uv;
+layout(location = 6) flat in uint in_instance_index;
 
 void get_surface_info(
     instance inst,
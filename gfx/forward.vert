@@ -6,9 +6,13 @@
 
 #define RAYBASE_SCENE_SET 0
 #include "scene.glsl"
+#include "math.glsl"
 
-layout(location = 0) in vec3 in_pos;
-layout(location = 1) in vec3 in_normal;
+// Set when drawing primitives with packed attributes.
+layout(constant_id = 13) const uint RB_PACKED_VERTICES = 0;
+
+layout(location = 0) in vec4 in_pos;
+layout(location = 1) in vec4 in_normal;
 layout(location = 2) in vec4 in_tangent;
 layout(location = 3) in vec2 in_uv;
 layout(location = 4) in vec2 in_lightmap_uv;
@@ -19,23 +23,41 @@ layout(location = 2) out vec3 out_tangent;
 layout(location = 3) out vec3 out_bitangent;
 layout(location = 4) out vec2 out_uv;
 layout(location = 5) out vec2 out_lightmap_uv;
+layout(location = 6) flat out uint out_instance_index;
 
 layout(push_constant) uniform push_constant_buffer
 {
     uint instance_index;
     uint camera_index;
+    layout(offset = 48) vec4 position_offset;
+    vec4 position_scale;
+    vec4 uv_transform;
 } pc;
 
 void main()
 {
-    const instance inst = instances.array[pc.instance_index];
+    // Indirect draws pass the instance index in firstInstance instead.
+    uint instance_index = pc.instance_index + uint(gl_InstanceIndex);
+    const instance inst = instances.array[instance_index];
     const camera cam = cameras.array[pc.camera_index];
 
-    out_pos = (inst.model_to_world * vec4(in_pos, 1)).xyz;
+    vec3 pos = in_pos.xyz;
+    vec3 normal = in_normal.xyz;
+    vec4 tangent = in_tangent;
+    if(RB_PACKED_VERTICES != 0)
+    {
+        pos = pc.position_offset.xyz + pos * pc.position_scale.xyz;
+        normal = octahedral_decode(in_normal.xy);
+        tangent = octahedral_decode_tangent(in_tangent.xy);
+    }
+
+    out_pos = (inst.model_to_world * vec4(pos, 1)).xyz;
     gl_Position = cam.view_proj * vec4(out_pos, 1);
-    out_uv = in_uv;
+    out_instance_index = instance_index;
+    out_uv = RB_PACKED_VERTICES != 0 ?
+        pc.uv_transform.xy + in_uv * pc.uv_transform.zw : in_uv;
     out_lightmap_uv = in_lightmap_uv;
-    out_normal = normalize(mat3(inst.normal_to_world) * in_normal);
-    out_tangent = normalize(mat3(inst.model_to_world) * in_tangent.xyz);
-    out_bitangent = cross(out_normal, out_tangent) * in_tangent.w;
+    out_normal = normalize(mat3(inst.normal_to_world) * normal);
+    out_tangent = normalize(mat3(inst.model_to_world) * tangent.xyz);
+    out_bitangent = cross(out_normal, out_tangent) * tangent.w;
 }
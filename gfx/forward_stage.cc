@@ -1,5 +1,6 @@
 #include "forward_stage.hh"
 #include "clustering_stage.hh"
+#include "indirect_draw_stage.hh"
 #include "primitive.hh"
 #include "light.hh"
 #include "model.hh"
@@ -28,6 +29,10 @@ struct push_constant_buffer
     uint32_t camera_index;
     float pad[2];
     rasterizer_config config;
+    pvec4 position_offset;
+    pvec4 position_scale;
+    // Texture UV offset in xy, scale in zw.
+    pvec4 uv_transform;
 };
 
 void set_stencil_params(raster_pipeline::params& params, const forward_stage::options& opt)
@@ -64,6 +69,109 @@ constexpr primitive::attribute_flag attributes =
         primitive::TANGENT |
         primitive::TEXTURE_UV |
         primitive::LIGHTMAP_UV;
+
+// Returns the attribute mask to draw the primitive with and sets up the
+// position dequantization for packed primitives.
+primitive::attribute_flag prepare_packed_draw(
+    const primitive* prim,
+    primitive::attribute_flag mask,
+    push_constant_buffer& pc
+){
+    if(!prim->is_packed())
+        return mask;
+    aabb range = prim->get_position_quantization_range();
+    pc.position_offset = vec4(range.min, 0);
+    pc.position_scale = vec4(range.max - range.min, 0);
+    vec4 uv_range = prim->get_texture_uv_quantization_range();
+    pc.uv_transform = vec4(
+        uv_range.x, uv_range.y, uv_range.z - uv_range.x, uv_range.w - uv_range.y
+    );
+    return primitive::get_packed_attributes(mask);
+}
+
+// Draws the render list entries in [begin, end). The push constants are
+// copied, so that parallel tasks can each use their own.
+void draw_entries(
+    VkCommandBuffer cmd,
+    scene* s,
+    const std::vector<scene_stage::render_entry>& render_list,
+    size_t begin,
+    size_t end,
+    uint32_t entry_mask,
+    const descriptor_set& scene_set,
+    raster_pipeline& plain_pipeline,
+    raster_pipeline& packed_pipeline,
+    primitive::attribute_flag attribs,
+    bool opaque_only,
+    bool material_stencil,
+    push_constant_buffer pc
+){
+    raster_pipeline* bound = nullptr;
+    for(size_t i = begin; i < end; ++i)
+    {
+        const auto& entry = render_list[i];
+        if((entry.mask & entry_mask) == 0)
+            continue;
+        model& m = *s->get<model>(entry.id);
+        const material& mat = m.materials[entry.vertex_group_index];
+        if(opaque_only && mat.potentially_transparent())
+            continue;
+        const primitive* prim = (*m.m)[entry.vertex_group_index].get_primitive();
+
+        raster_pipeline* p = prim->is_packed() ? &packed_pipeline : &plain_pipeline;
+        if(p != bound)
+        {
+            p->bind(cmd);
+            p->set_descriptors(cmd, scene_set);
+            bound = p;
+        }
+        pc.instance_index = entry.instance_index;
+        primitive::attribute_flag mask = prepare_packed_draw(prim, attribs, pc);
+        p->push_constants(cmd, &pc);
+
+        if(material_stencil)
+            vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
+        prim->draw(cmd, mask);
+    }
+}
+
+void draw_indirect_batches(
+    VkCommandBuffer cmd,
+    const indirect_draw_stage& indirect_draw,
+    const descriptor_set& scene_set,
+    raster_pipeline& plain_pipeline,
+    raster_pipeline& packed_pipeline,
+    primitive::attribute_flag attribs,
+    bool opaque_only,
+    bool material_stencil,
+    push_constant_buffer& pc
+){
+    // The instance index comes from firstInstance.
+    pc.instance_index = 0;
+    const auto& batches = indirect_draw.get_batches();
+    raster_pipeline* bound = nullptr;
+    for(size_t i = 0; i < batches.size(); ++i)
+    {
+        const indirect_draw_stage::batch& b = batches[i];
+        if(opaque_only && b.potentially_transparent)
+            continue;
+
+        raster_pipeline* p = b.prim->is_packed() ? &packed_pipeline : &plain_pipeline;
+        if(p != bound)
+        {
+            p->bind(cmd);
+            p->set_descriptors(cmd, scene_set);
+            bound = p;
+        }
+        primitive::attribute_flag mask = prepare_packed_draw(b.prim, attribs, pc);
+        p->push_constants(cmd, &pc);
+
+        if(material_stencil)
+            vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, b.stencil_reference);
+        indirect_draw.draw(cmd, 0, i, mask);
+    }
+}
+
 }
 
 namespace rb::gfx
@@ -80,6 +188,8 @@ forward_stage::forward_stage(
     pass(clustering.get_device()),
     z_pre_pass(clustering.get_device()),
     pipeline(clustering.get_device()),
+    packed_z_pre_pass(clustering.get_device()),
+    packed_pipeline(clustering.get_device()),
     stage_timer(clustering.get_device(), "forward pass")
 {
     render_target* targets[] = {&color_buffer, &depth_buffer};
@@ -96,12 +206,42 @@ forward_stage::forward_stage(
     }
     fb.init(pass, targets);
 
-    unsigned subpass_index = 0;
-
-    if(opt.z_pre_pass)
+    for(bool packed: {false, true})
     {
-        auto bind_desc = primitive::get_bindings(primitive::POSITION);
-        auto attr_desc = primitive::get_attributes(primitive::POSITION);
+        unsigned subpass_index = 0;
+        if(opt.z_pre_pass)
+        {
+            primitive::attribute_flag mask = packed ?
+                primitive::get_packed_attributes(primitive::POSITION) :
+                primitive::POSITION;
+            auto bind_desc = primitive::get_bindings(mask);
+            auto attr_desc = primitive::get_attributes(mask);
+
+            raster_pipeline::params params(
+                pass, subpass_index++,
+                fb.get_size(),
+                bind_desc.size(),
+                bind_desc.data(),
+                attr_desc.size(),
+                attr_desc.data()
+            );
+            set_stencil_params(params, opt);
+
+            raster_shader_data shader;
+            shader.vertex = z_pre_pass_vert_shader_binary;
+            shader.vertex.specialization[13] = packed ? 1 : 0;
+            shader.fragment = z_pre_pass_frag_shader_binary;
+
+            (packed ? packed_z_pre_pass : z_pre_pass).init(
+                params, shader, sizeof(push_constant_buffer),
+                scene_data->get_descriptor_set().get_layout()
+            );
+        }
+
+        primitive::attribute_flag mask = packed ?
+            primitive::get_packed_attributes(attributes) : attributes;
+        auto bind_desc = primitive::get_bindings(mask);
+        auto attr_desc = primitive::get_attributes(mask);
 
         raster_pipeline::params params(
             pass, subpass_index++,
@@ -114,38 +254,17 @@ forward_stage::forward_stage(
         set_stencil_params(params, opt);
 
         raster_shader_data shader;
-        shader.vertex = z_pre_pass_vert_shader_binary;
-        shader.fragment = z_pre_pass_frag_shader_binary;
-
-        z_pre_pass.init(
+        shader.vertex = forward_vert_shader_binary;
+        shader.vertex.specialization[13] = packed ? 1 : 0;
+        shader.fragment = forward_frag_shader_binary;
+        clustering.get_specialization_info(shader.fragment.specialization);
+        shader.fragment.specialization[11] = opt.dynamic_lighting ? 1 : 0;
+        shader.fragment.specialization[12] = opt.alpha_discard ? 1 : 0;
+        (packed ? packed_pipeline : pipeline).init(
             params, shader, sizeof(push_constant_buffer),
             scene_data->get_descriptor_set().get_layout()
         );
     }
-
-    auto bind_desc = primitive::get_bindings(attributes);
-    auto attr_desc = primitive::get_attributes(attributes);
-
-    raster_pipeline::params params(
-        pass, subpass_index++,
-        fb.get_size(),
-        bind_desc.size(),
-        bind_desc.data(),
-        attr_desc.size(),
-        attr_desc.data()
-    );
-    set_stencil_params(params, opt);
-
-    raster_shader_data shader;
-    shader.vertex = forward_vert_shader_binary;
-    shader.fragment = forward_frag_shader_binary;
-    clustering.get_specialization_info(shader.fragment.specialization);
-    shader.fragment.specialization[11] = opt.dynamic_lighting ? 1 : 0;
-    shader.fragment.specialization[12] = opt.alpha_discard ? 1 : 0;
-    pipeline.init(
-        params, shader, sizeof(push_constant_buffer),
-        scene_data->get_descriptor_set().get_layout()
-    );
 }
 
 void forward_stage::update_buffers(uint32_t frame_index)
@@ -165,57 +284,73 @@ void forward_stage::update_buffers(uint32_t frame_index)
     });
     pc.config.ambient = vec4(ambient, 0);
 
-    pass.begin(cmd, fb);
-
-    if(opt.z_pre_pass)
-    {
-        z_pre_pass.bind(cmd);
-        z_pre_pass.set_descriptors(cmd, scene_data->get_descriptor_set());
-
-        for(auto& entry: scene_data->get_render_list(camera_id))
+    const auto& render_list = scene_data->get_render_list(camera_id);
+    const descriptor_set& scene_set = scene_data->get_descriptor_set();
+    bool material_stencil = opt.enable_stencil && opt.use_material_stencil;
+    size_t task_count = 1;
+    if(opt.parallel_recording && !opt.indirect_draw)
+        task_count = get_parallel_task_count(render_list.size());
+    VkSubpassContents contents = task_count > 1 ?
+        VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
+        VK_SUBPASS_CONTENTS_INLINE;
+
+    auto record = [&](
+        uint32_t subpass_index,
+        raster_pipeline& plain_pipeline,
+        raster_pipeline& packed_pipeline,
+        primitive::attribute_flag attribs,
+        bool opaque_only
+    ){
+        if(opt.indirect_draw)
         {
-            if((entry.mask & opt.mask) == 0)
-                continue;
-            pc.instance_index = entry.instance_index;
-            z_pre_pass.push_constants(cmd, &pc);
-            model& m = *s->get<model>(entry.id);
-            const material& mat = m.materials[entry.vertex_group_index];
-
-            if(opt.enable_stencil && opt.use_material_stencil)
-                vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
-            auto& vg = (*m.m)[entry.vertex_group_index];
-            if(!mat.potentially_transparent())
-                vg.get_primitive()->draw(cmd, primitive::POSITION);
+            draw_indirect_batches(
+                cmd, *opt.indirect_draw, scene_set,
+                plain_pipeline, packed_pipeline, attribs,
+                opaque_only, material_stencil, pc
+            );
         }
-
-        pass.next(cmd);
-    }
-
-    pipeline.bind(cmd);
-    pipeline.set_descriptors(cmd, scene_data->get_descriptor_set());
-
-    for(auto& entry: scene_data->get_render_list(camera_id))
-    {
-        if((entry.mask & opt.mask) == 0)
-            continue;
-
-        pc.instance_index = entry.instance_index;
-        pipeline.push_constants(cmd, &pc);
-        model& m = *s->get<model>(entry.id);
-
-        if(opt.enable_stencil && opt.use_material_stencil)
+        else if(task_count > 1)
         {
-            const material& mat = m.materials[entry.vertex_group_index];
-            vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
+            record_parallel_graphics(
+                cmd, pass, subpass_index, fb, task_count,
+                [&](VkCommandBuffer task_cmd, size_t task_index){
+                    size_t begin, end;
+                    get_parallel_task_range(
+                        render_list.size(), task_count, task_index, begin, end
+                    );
+                    draw_entries(
+                        task_cmd, s, render_list, begin, end, opt.mask,
+                        scene_set, plain_pipeline, packed_pipeline, attribs,
+                        opaque_only, material_stencil, pc
+                    );
+                }
+            );
+        }
+        else
+        {
+            draw_entries(
+                cmd, s, render_list, 0, render_list.size(), opt.mask,
+                scene_set, plain_pipeline, packed_pipeline, attribs,
+                opaque_only, material_stencil, pc
+            );
         }
+    };
 
-        (*m.m)[entry.vertex_group_index].get_primitive()->draw(cmd, attributes);
+    pass.begin(cmd, fb, contents);
+    uint32_t subpass_index = 0;
+    if(opt.z_pre_pass)
+    {
+        record(
+            subpass_index++, z_pre_pass, packed_z_pre_pass,
+            primitive::POSITION, true
+        );
+        pass.next(cmd, contents);
     }
-
+    record(subpass_index, pipeline, packed_pipeline, attributes, false);
     pass.end(cmd);
+
     stage_timer.stop(cmd, frame_index);
     use_graphics_commands(cmd, frame_index);
 }
 
 }
-
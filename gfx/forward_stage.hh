@@ -14,6 +14,7 @@ namespace rb::gfx
 
 class scene_stage;
 class clustering_stage;
+class indirect_draw_stage;
 
 class forward_stage: public render_stage
 {
@@ -39,6 +40,16 @@ public:
         VkCompareOp compare_op = VK_COMPARE_OP_ALWAYS;
         VkStencilOp fail_op = VK_STENCIL_OP_KEEP;
         VkStencilOp pass_op = VK_STENCIL_OP_REPLACE;
+
+        // If set, draws come from this stage instead of the render list, and
+        // its mask is used instead of the one above. The stage must run
+        // before this one, and this stage draws its first view group.
+        indirect_draw_stage* indirect_draw = nullptr;
+
+        // Splits draw recording over the thread pool into secondary command
+        // buffers when the render list is large enough. Not used with
+        // indirect_draw, which records few draws anyway.
+        bool parallel_recording = false;
     };
 
     forward_stage(
@@ -57,6 +68,8 @@ private:
     render_pass pass;
     framebuffer fb;
     raster_pipeline z_pre_pass, pipeline;
+    // Variants for primitives with packed vertex attributes.
+    raster_pipeline packed_z_pre_pass, packed_pipeline;
     timer stage_timer;
 };
 
@@ -2,6 +2,13 @@
 #include "core/error.hh"
 #include "device.hh"
 
+namespace
+{
+
+thread_local rb::gfx::garbage_collector::batch_scope* current_batch_scope = nullptr;
+
+}
+
 namespace rb::gfx
 {
 
@@ -29,6 +36,26 @@ void garbage_collector::depend(void* used_resource, VkSemaphore timeline, uint64
     depend_impl(used_resource, timeline, value);
 }
 
+garbage_collector::batch_scope::batch_scope(garbage_collector& gc)
+: gc(&gc), prev_scope(current_batch_scope)
+{
+    current_batch_scope = this;
+}
+
+garbage_collector::batch_scope::~batch_scope()
+{
+    current_batch_scope = prev_scope;
+    if(dependencies.size() == 0)
+        return;
+
+    std::unique_lock lk(gc->mutex);
+    for(auto [used_resource, user_resource]: dependencies)
+    {
+        gc->resources[user_resource].dependents.push_back(used_resource);
+        gc->resources[used_resource].dependency_count++;
+    }
+}
+
 void garbage_collector::remove(void* resource, std::function<void()>&& cleanup)
 {
     std::unique_lock lk(mutex);
@@ -118,6 +145,13 @@ bool garbage_collector::trigger::operator<(const trigger& t) const
 
 void garbage_collector::depend_impl(argvec<void*> used_resource, void* user_resource)
 {
+    if(current_batch_scope && current_batch_scope->gc == this)
+    {
+        for(void* res: used_resource)
+            current_batch_scope->dependencies.push_back({res, user_resource});
+        return;
+    }
+
     std::unique_lock lk(mutex);
     auto& dependents = resources[user_resource].dependents;
     dependents.insert(dependents.end(), used_resource.begin(), used_resource.end());
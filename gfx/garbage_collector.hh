@@ -66,6 +66,25 @@ public:
     void depend_many(argvec<void*> used_resource, void* user_resource);
     void depend(void* used_resource, VkSemaphore timeline, uint64_t value);
 
+    // While a batch_scope exists, depend() and depend_many() calls on the
+    // same thread are only collected and get applied with a single lock when
+    // the scope ends. This keeps threads that record commands in parallel
+    // from contending on the mutex for every bind. Semaphore dependencies are
+    // not batched.
+    class batch_scope
+    {
+    friend class garbage_collector;
+    public:
+        batch_scope(garbage_collector& gc);
+        batch_scope(const batch_scope& other) = delete;
+        ~batch_scope();
+
+    private:
+        garbage_collector* gc;
+        batch_scope* prev_scope;
+        std::vector<std::pair<void* /*used*/, void* /*user*/>> dependencies;
+    };
+
 #ifdef RAYBASE_GFX_GARBAGE_COLLECTOR_DEBUG
     template<typename... Args>
     void add_label(const void* resource, int line, const char* file, const Args&... rest)
@@ -16,9 +16,11 @@
 #include "gpu_buffer.hh"
 #include "gpu_pipeline.hh"
 #include "headless.hh"
+#include "indirect_draw_stage.hh"
 #include "light.hh"
 #include "material.hh"
 #include "mesh.hh"
+#include "meshlet_culling_stage.hh"
 #include "model.hh"
 #include "multiview_forward_stage.hh"
 #include "multiview_layout_stage.hh"
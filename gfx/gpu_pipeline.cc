@@ -5,6 +5,15 @@
 #include "texture.hh"
 #include "sampler.hh"
 #include "core/stack_allocator.hh"
+#include "context.hh"
+#include <algorithm>
+
+namespace
+{
+
+thread_local rb::gfx::gpu_pipeline::parallel_compile_scope* current_compile_scope = nullptr;
+
+}
 
 namespace rb::gfx
 {
@@ -42,8 +51,70 @@ gpu_pipeline::gpu_pipeline(device& dev, VkPipelineBindPoint bind_point)
 {
 }
 
+gpu_pipeline::gpu_pipeline(gpu_pipeline&& other) noexcept
+{
+    // The compilation task refers to 'other', so it must be done first.
+    other.leave_compile_scope();
+    dev = other.dev;
+    pipeline = std::move(other.pipeline);
+    pipeline_layout = std::move(other.pipeline_layout);
+    bind_point = other.bind_point;
+    push_constant_size = other.push_constant_size;
+}
+
 gpu_pipeline::~gpu_pipeline()
 {
+    leave_compile_scope();
+}
+
+gpu_pipeline::parallel_compile_scope::parallel_compile_scope()
+: prev_scope(current_compile_scope)
+{
+    current_compile_scope = this;
+}
+
+gpu_pipeline::parallel_compile_scope::~parallel_compile_scope()
+{
+    // Resetting the tickets here makes finish_compile() read-only afterwards,
+    // so the pipelines can be used from multiple threads at once.
+    for(gpu_pipeline* p: pipelines)
+    {
+        p->compile_ticket.wait();
+        p->compile_ticket = thread_pool::ticket();
+        p->compile_scope = nullptr;
+    }
+    current_compile_scope = prev_scope;
+}
+
+void gpu_pipeline::compile(std::function<void()>&& create, bool allow_deferred)
+{
+    // Re-initializing must not race with the previous compilation.
+    leave_compile_scope();
+
+    if(current_compile_scope && allow_deferred)
+    {
+        compile_ticket = dev->ctx->get_thread_pool().add_task(std::move(create));
+        compile_scope = current_compile_scope;
+        compile_scope->pipelines.push_back(this);
+    }
+    else create();
+}
+
+void gpu_pipeline::finish_compile() const
+{
+    compile_ticket.wait();
+}
+
+void gpu_pipeline::leave_compile_scope()
+{
+    finish_compile();
+    compile_ticket = thread_pool::ticket();
+    if(compile_scope)
+    {
+        std::vector<gpu_pipeline*>& pipelines = compile_scope->pipelines;
+        pipelines.erase(std::find(pipelines.begin(), pipelines.end(), this));
+        compile_scope = nullptr;
+    }
 }
 
 void gpu_pipeline::init_bindings(
@@ -79,6 +150,7 @@ void gpu_pipeline::init_bindings(
 
 void gpu_pipeline::push_constants(VkCommandBuffer buf, const void* data)
 {
+    finish_compile();
     vkCmdPushConstants(
         buf, pipeline_layout, VK_SHADER_STAGE_ALL, 0,
         (uint32_t)push_constant_size, data
@@ -87,6 +159,7 @@ void gpu_pipeline::push_constants(VkCommandBuffer buf, const void* data)
 
 void gpu_pipeline::bind(VkCommandBuffer buf)
 {
+    finish_compile();
     vkCmdBindPipeline(buf, bind_point, pipeline);
     dev->gc.depend(*pipeline, buf);
 }
@@ -97,6 +170,7 @@ void gpu_pipeline::set_descriptors(
     uint32_t index,
     uint32_t set_index
 ){
+    finish_compile();
     set.bind(buf, *pipeline_layout, bind_point, index, set_index);
 }
 
@@ -105,6 +179,7 @@ void gpu_pipeline::push_descriptors(
     push_descriptor_set& set,
     uint32_t set_index
 ){
+    finish_compile();
     set.push(buf, *pipeline_layout, bind_point, set_index);
 }
 
@@ -2,6 +2,7 @@
 #define RAYBASE_GFX_GPU_PIPELINE_HH
 
 #include "descriptor_set.hh"
+#include "core/thread_pool.hh"
 #include <map>
 
 #define RB_SHADER_REGISTRY_ENTRY(binary, binary_path, source_path) \
@@ -58,7 +59,7 @@ class gpu_pipeline
 {
 public:
     gpu_pipeline(device& dev, VkPipelineBindPoint bind_point);
-    gpu_pipeline(gpu_pipeline&& other) noexcept = default;
+    gpu_pipeline(gpu_pipeline&& other) noexcept;
     ~gpu_pipeline();
 
     void push_constants(VkCommandBuffer buf, const void* data);
@@ -83,7 +84,33 @@ public:
     );
     static void get_hooked_shader(shader_data& data);
 
+    // Pipelines initialized on this thread while a scope exists are compiled
+    // on the thread pool instead of blocking the caller. Every other member
+    // function waits for the compilation to finish, so the pipelines can be
+    // used as usual. The scope waits for all of its pipelines when it ends.
+    // Until then, the pipelines must only be used by the thread that owns the
+    // scope; afterwards, they can be used from any number of threads.
+    class parallel_compile_scope
+    {
+    friend class gpu_pipeline;
+    public:
+        parallel_compile_scope();
+        parallel_compile_scope(const parallel_compile_scope& other) = delete;
+        ~parallel_compile_scope();
+
+    private:
+        parallel_compile_scope* prev_scope;
+        std::vector<gpu_pipeline*> pipelines;
+    };
+
 protected:
+    // Runs 'create' immediately, or on the thread pool if there is a
+    // parallel_compile_scope and 'allow_deferred' is set. 'create' must own
+    // copies of everything it uses from the arguments of init().
+    void compile(std::function<void()>&& create, bool allow_deferred = true);
+    void finish_compile() const;
+    void leave_compile_scope();
+
     void init_bindings(
         size_t push_constant_size = 0,
         argvec<VkDescriptorSetLayout> sets = {}
@@ -97,6 +124,8 @@ protected:
     vkres<VkPipelineLayout> pipeline_layout;
     VkPipelineBindPoint bind_point;
     size_t push_constant_size;
+    mutable thread_pool::ticket compile_ticket;
+    parallel_compile_scope* compile_scope = nullptr;
 };
 
 }
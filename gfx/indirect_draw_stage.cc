@@ -0,0 +1,262 @@
+#include "indirect_draw_stage.hh"
+#include "vulkan_helpers.hh"
+#include "primitive.hh"
+#include "model.hh"
+#include "indirect_draw.comp.h"
+
+namespace
+{
+using namespace rb;
+using namespace rb::gfx;
+
+struct push_constant_buffer
+{
+    uint32_t record_count;
+    uint32_t batch_count;
+    uint32_t camera_count;
+    uint32_t view_group_size;
+};
+
+// maxComputeWorkGroupCount[0] is guaranteed to be at least this.
+constexpr uint32_t max_dispatch_width = 65535;
+
+}
+
+namespace rb::gfx
+{
+
+indirect_draw_stage::indirect_draw_stage(
+    scene_stage& s,
+    const options& opt
+):  render_stage(s.get_device()),
+    opt(opt),
+    scene_data(&s),
+    stage_timer(s.get_device(), "indirect draw culling"),
+    pipeline(s.get_device()),
+    descriptors(s.get_device()),
+    group_count(0),
+    batch_buffer(s.get_device(), 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+    record_buffer(s.get_device(), 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+    draw_capacity(0),
+    draw_count_capacity(0)
+{
+    RB_CHECK(
+        opt.view_group_size == 0 || opt.view_group_size > 32,
+        "view_group_size must be between 1 and 32."
+    );
+    RB_CHECK(
+        !dev->vulkan12_features.drawIndirectCount,
+        "Indirect draws require drawIndirectCount."
+    );
+    RB_CHECK(
+        !dev->physical_device_features.features.drawIndirectFirstInstance,
+        "Indirect draws require drawIndirectFirstInstance."
+    );
+
+    shader_data shader(indirect_draw_comp_shader_binary);
+    descriptors.add(shader);
+    pipeline.init(
+        shader,
+        sizeof(push_constant_buffer),
+        {descriptors.get_layout(), scene_data->get_descriptor_set().get_layout()}
+    );
+}
+
+const std::vector<indirect_draw_stage::batch>& indirect_draw_stage::get_batches() const
+{
+    return batches;
+}
+
+void indirect_draw_stage::draw(
+    VkCommandBuffer cmd,
+    uint32_t group_index,
+    size_t batch_index,
+    primitive::attribute_flag mask
+) const {
+    if(group_index >= group_count || batch_index >= batches.size())
+        return;
+
+    batches[batch_index].prim->draw_indirect(
+        cmd, mask,
+        *draw_buffer,
+        (group_index * records.size() + gpu_batches[batch_index].first_draw) *
+            sizeof(VkDrawIndexedIndirectCommand),
+        *draw_count_buffer,
+        (group_index * batches.size() + batch_index) * sizeof(uint32_t),
+        batch_sizes[batch_index]
+    );
+}
+
+uint32_t indirect_draw_stage::get_view_group_size() const
+{
+    return opt.view_group_size;
+}
+
+scene_stage* indirect_draw_stage::get_scene_data() const
+{
+    return scene_data;
+}
+
+void indirect_draw_stage::update_buffers(uint32_t frame_index)
+{
+    batches.clear();
+    batch_indices.clear();
+    batch_sizes.clear();
+    gpu_batches.clear();
+    records.clear();
+
+    // Batches are rebuilt every frame, but this is only a hash lookup per
+    // instance, which is far cheaper than recording draws for each of them.
+    scene* s = scene_data->get_scene();
+    for(const auto& entry: scene_data->get_render_list())
+    {
+        if((entry.mask & opt.mask) == 0)
+            continue;
+
+        model& m = *s->get<model>(entry.id);
+        const material& mat = m.materials[entry.vertex_group_index];
+        batch_key key = {
+            (*m.m)[entry.vertex_group_index].get_primitive(),
+            mat.stencil_reference,
+            mat.potentially_transparent()
+        };
+        auto it = batch_indices.emplace(key, batches.size()).first;
+        if(it->second == batches.size())
+        {
+            batches.push_back({
+                key.prim, key.stencil_reference, key.potentially_transparent
+            });
+            batch_sizes.push_back(0);
+        }
+        records.push_back({(uint32_t)entry.instance_index, it->second});
+        batch_sizes[it->second]++;
+    }
+
+    uint32_t first_draw = 0;
+    for(size_t i = 0; i < batches.size(); ++i)
+    {
+        gpu_batch& b = gpu_batches.emplace_back();
+        aabb bounding_box;
+        if(!batches[i].prim->get_bounding_box(bounding_box))
+            bounding_box = {vec3(1), vec3(-1)};
+        b.aabb_min = pvec3(bounding_box.min);
+        b.aabb_max = pvec3(bounding_box.max);
+        b.index_count = batches[i].prim->get_index_count();
+        b.first_draw = first_draw;
+        first_draw += batch_sizes[i];
+    }
+
+    uint32_t camera_count = scene_data->get_active_cameras().size();
+    group_count = (camera_count + opt.view_group_size - 1) / opt.view_group_size;
+    if(records.size() == 0)
+        group_count = 0;
+
+    size_t count_count = group_count * batches.size();
+    if(group_count != 0)
+    {
+        VkBufferUsageFlags usage =
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT|
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        size_t draw_count = group_count * records.size();
+        if(draw_capacity < draw_count)
+        {
+            draw_capacity = draw_count * 2;
+            draw_buffer = create_gpu_buffer(
+                *dev, draw_capacity * sizeof(VkDrawIndexedIndirectCommand), usage
+            );
+        }
+        if(draw_count_capacity < count_count)
+        {
+            draw_count_capacity = count_count * 2;
+            draw_count_buffer = create_gpu_buffer(
+                *dev, draw_count_capacity * sizeof(uint32_t), usage
+            );
+        }
+
+        batch_buffer.resize(gpu_batches.size() * sizeof(gpu_batch));
+        batch_buffer.update_ptr(
+            frame_index, gpu_batches.data(), gpu_batches.size() * sizeof(gpu_batch)
+        );
+        record_buffer.resize(records.size() * sizeof(draw_record));
+        record_buffer.update_ptr(
+            frame_index, records.data(), records.size() * sizeof(draw_record)
+        );
+    }
+
+    // The batch and record contents only reach the GPU through the staging
+    // buffers, so the commands only depend on the sizes and buffers.
+    size_t state_hash = 0;
+    hash_combine(state_hash, records.size());
+    hash_combine(state_hash, batches.size());
+    hash_combine(state_hash, camera_count);
+    hash_combine(state_hash, group_count);
+    hash_combine(state_hash, (VkBuffer)batch_buffer);
+    hash_combine(state_hash, (VkBuffer)record_buffer);
+    hash_combine(state_hash, *draw_buffer);
+    hash_combine(state_hash, *draw_count_buffer);
+    hash_combine(state_hash, scene_data->get_descriptor_set().get_version());
+    if(reuse_commands(frame_index, state_hash))
+        return;
+
+    VkCommandBuffer cmd = compute_commands();
+    stage_timer.start(cmd, frame_index);
+
+    if(group_count != 0)
+    {
+        upload(cmd, {&batch_buffer, &record_buffer}, frame_index);
+
+        vkCmdFillBuffer(
+            cmd, *draw_count_buffer, 0, count_count * sizeof(uint32_t), 0
+        );
+        buffer_barrier(cmd, *draw_count_buffer);
+
+        descriptors.set_buffer("batches", (VkBuffer)batch_buffer);
+        descriptors.set_buffer("records", (VkBuffer)record_buffer);
+        descriptors.set_buffer("draws", *draw_buffer);
+        descriptors.set_buffer("draw_counts", *draw_count_buffer);
+
+        pipeline.bind(cmd);
+        pipeline.push_descriptors(cmd, descriptors, 0);
+        pipeline.set_descriptors(cmd, scene_data->get_descriptor_set(), 0, 1);
+
+        push_constant_buffer pc;
+        pc.record_count = records.size();
+        pc.batch_count = batches.size();
+        pc.camera_count = camera_count;
+        pc.view_group_size = opt.view_group_size;
+        pipeline.push_constants(cmd, &pc);
+
+        uint32_t workgroups = (records.size() + 63) / 64;
+        uint32_t width = min(workgroups, max_dispatch_width);
+        pipeline.dispatch(
+            cmd, uvec3(width, (workgroups + width - 1) / width, 1)
+        );
+
+        buffer_barrier(cmd, *draw_buffer);
+        buffer_barrier(cmd, *draw_count_buffer);
+        dev->gc.depend(*draw_buffer, cmd);
+        dev->gc.depend(*draw_count_buffer, cmd);
+    }
+
+    stage_timer.stop(cmd, frame_index);
+    use_compute_commands(cmd, frame_index);
+}
+
+bool indirect_draw_stage::batch_key::operator==(const batch_key& other) const
+{
+    return prim == other.prim &&
+        stencil_reference == other.stencil_reference &&
+        potentially_transparent == other.potentially_transparent;
+}
+
+size_t indirect_draw_stage::batch_key_hash::operator()(const batch_key& key) const
+{
+    size_t seed = 0;
+    hash_combine(seed, key.prim);
+    hash_combine(seed, key.stencil_reference);
+    hash_combine(seed, key.potentially_transparent);
+    return seed;
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef RAYBASE_GFX_INDIRECT_DRAW_STAGE_HH
+#define RAYBASE_GFX_INDIRECT_DRAW_STAGE_HH
+
+#include "scene_stage.hh"
+#include "compute_pipeline.hh"
+#include "gpu_buffer.hh"
+#include "timer.hh"
+#include <unordered_map>
+
+namespace rb::gfx
+{
+
+// Culls all instances of the scene against camera frusta on the GPU and
+// writes the survivors as indirect draws for forward_stage and
+// multiview_forward_stage. Instances are grouped into batches that share a
+// primitive and the material state that can't be changed within an indirect
+// draw, so the CPU only records one draw per batch instead of one per
+// instance. Each draw passes its instance index in firstInstance.
+//
+// Only the unculled render list of scene_stage is used, so you can disable
+// scene_stage::options::frustum_culling if nothing else needs the culled
+// lists.
+class indirect_draw_stage: public render_stage
+{
+public:
+    struct options
+    {
+        // Active cameras are culled in consecutive groups of this many
+        // cameras (at most 32). Match this with
+        // multiview_forward_stage::options::max_view_group_size, or use 1
+        // with forward_stage.
+        uint32_t view_group_size = 1;
+
+        // Only instances whose rb::gfx::rendered.mask & mask != 0 are drawn.
+        // This replaces the mask of the stages using the draws.
+        uint32_t mask = 0xFFFFFFFF;
+    };
+
+    indirect_draw_stage(scene_stage& s, const options& opt);
+    indirect_draw_stage(indirect_draw_stage&&) = delete;
+
+    struct batch
+    {
+        const primitive* prim;
+        uint32_t stencil_reference;
+        bool potentially_transparent;
+    };
+    const std::vector<batch>& get_batches() const;
+
+    // Draws the visible instances of the batch in the given view group.
+    void draw(
+        VkCommandBuffer cmd,
+        uint32_t group_index,
+        size_t batch_index,
+        primitive::attribute_flag mask
+    ) const;
+
+    uint32_t get_view_group_size() const;
+    scene_stage* get_scene_data() const;
+
+protected:
+    void update_buffers(uint32_t frame_index) override;
+
+private:
+    struct batch_key
+    {
+        const primitive* prim;
+        uint32_t stencil_reference;
+        bool potentially_transparent;
+
+        bool operator==(const batch_key& other) const;
+    };
+
+    struct batch_key_hash
+    {
+        size_t operator()(const batch_key& key) const;
+    };
+
+    struct gpu_batch
+    {
+        // Empty if the batch cannot be culled.
+        pvec3 aabb_min;
+        uint32_t index_count;
+        pvec3 aabb_max;
+        uint32_t first_draw;
+    };
+
+    struct draw_record
+    {
+        uint32_t instance_index;
+        uint32_t batch_index;
+    };
+
+    options opt;
+    scene_stage* scene_data;
+    timer stage_timer;
+    compute_pipeline pipeline;
+    push_descriptor_set descriptors;
+
+    uint32_t group_count;
+    std::vector<batch> batches;
+    std::unordered_map<batch_key, uint32_t, batch_key_hash> batch_indices;
+    std::vector<uint32_t> batch_sizes;
+    std::vector<gpu_batch> gpu_batches;
+    std::vector<draw_record> records;
+
+    gpu_buffer batch_buffer;
+    gpu_buffer record_buffer;
+    vkres<VkBuffer> draw_buffer;
+    size_t draw_capacity;
+    vkres<VkBuffer> draw_count_buffer;
+    size_t draw_count_capacity;
+};
+
+}
+
+#endif
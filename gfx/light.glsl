@@ -240,4 +240,24 @@ vec3 sample_tri_light(
 }
 #endif
 
+// Extent of the point light's area of influence along the given world axis.
+vec2 point_light_axis_range(point_light pl, uint axis_index)
+{
+    float light_center = vec3(pl.pos_x, pl.pos_y, pl.pos_z)[axis_index];
+    float cutoff_radius = unpackHalf2x16(pl.radius_and_cutoff_radius).y;
+    float light_min = light_center - cutoff_radius;
+    float light_max = light_center + cutoff_radius;
+
+    float spot_radius = unpackHalf2x16(pl.shadow_map_index_and_spot_radius).y;
+    if(spot_radius > 0.0f)
+    { // Spotlight can potentially further tighten the bounds
+        float pd = octahedral_decode(unpackSnorm2x16(pl.direction))[axis_index];
+        float e = sqrt(1.0f - pd * pd);
+        float pe = light_center + pd * cutoff_radius;
+        light_min = max(min(light_center, pe - e * spot_radius), light_min);
+        light_max = min(max(light_center, pe + e * spot_radius), light_max);
+    }
+    return vec2(light_min, light_max);
+}
+
 #endif
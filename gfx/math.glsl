@@ -33,6 +33,15 @@ vec3 octahedral_decode(vec2 encoded_normal)
     return normalize(normal);
 }
 
+// Decodes tangents packed by primitive: the sign of the second component is
+// the bitangent sign and its magnitude maps [0.5, 1] back to [-1, 1].
+vec4 octahedral_decode_tangent(vec2 encoded_tangent)
+{
+    float bitangent_sign = encoded_tangent.y < 0.0f ? -1.0f : 1.0f;
+    encoded_tangent.y = (abs(encoded_tangent.y) - 0.75f) * 4.0f;
+    return vec4(octahedral_decode(encoded_tangent), bitangent_sign);
+}
+
 uint rgb_to_rgbe(vec3 color)
 {
     ivec3 ex;
@@ -1033,4 +1042,18 @@ float disocclusion_detect(vec3 normal1, vec3 pos1, vec3 normal2, vec3 pos2, floa
         clamp(1.0f - abs(dot(normal2, delta)) * inv_max_plane_dist, 0.0f, 1.0f);
 }
 
+// Only the side planes are tested, so that this doesn't depend on the depth
+// range or whether the far plane is infinite.
+bool sphere_outside_frustum(mat4 view_proj, vec3 center, float radius)
+{
+    mat4 m = transpose(view_proj);
+    vec4 planes[4] = vec4[](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1]);
+    for(int i = 0; i < 4; ++i)
+    {
+        if(dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+            return true;
+    }
+    return false;
+}
+
 #endif
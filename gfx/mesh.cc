@@ -1,5 +1,6 @@
 #include "mesh.hh"
 #include "model.hh"
+#include "camera.hh"
 #include "core/stack_set.hh"
 #include "core/stack_allocator.hh"
 
@@ -257,5 +258,83 @@ void update_mesh_animations(scene& ctx, time_ticks delta)
     });
 }
 
+namespace
+{
+
+uint32_t get_animation_update_interval(
+    float distance,
+    const animation_update_policy& policy
+){
+    if(distance <= policy.full_rate_distance)
+        return 1;
+    float steps = std::log2(distance / policy.full_rate_distance);
+    if(steps >= 31.0f)
+        return max(policy.max_interval, 1u);
+    return clamp(1u << uint32_t(steps), 1u, max(policy.max_interval, 1u));
+}
+
+}
+
+void set_animation_update_intervals(
+    scene& ctx,
+    argvec<entity> cameras,
+    const animation_update_policy& policy
+){
+    auto camera_pos = stack_allocate<vec3>(cameras.size());
+    auto camera_frusta = stack_allocate<frustum>(cameras.size());
+    size_t camera_count = 0;
+    for(entity id: cameras)
+    {
+        transformable* t = ctx.get<transformable>(id);
+        camera* c = ctx.get<camera>(id);
+        if(!t || !c) continue;
+        camera_pos[camera_count] = t->get_global_position();
+        camera_frusta[camera_count] = c->get_global_frustum(*t);
+        camera_count++;
+    }
+
+    auto get_distance = [&](vec3 pos){
+        float min_dist = camera_count == 0 ? 0.0f : FLT_MAX;
+        for(size_t i = 0; i < camera_count; ++i)
+            min_dist = min(min_dist, distance(pos, camera_pos[i]));
+        return min_dist;
+    };
+
+    // A mesh can be shared by multiple models, in which case the most
+    // demanding one decides.
+    stack_set<mesh*> reachable_meshes(ctx.count<model>());
+    ctx([&](entity id, transformable& t, model& m){
+        mesh* me = m.m;
+        if(!me || !me->is_animated())
+            return;
+
+        const mat4& transform = t.get_global_transform();
+        uint32_t interval = get_animation_update_interval(
+            get_distance(get_matrix_translation(transform)), policy
+        );
+
+        aabb box;
+        if(policy.throttle_offscreen && camera_count > 0 && me->get_bounding_box(box))
+        {
+            box = aabb_from_obb(box, transform);
+            bool visible = false;
+            for(size_t i = 0; i < camera_count && !visible; ++i)
+                visible = aabb_frustum_cull(box, camera_frusta[i]);
+            if(!visible)
+                interval = max(policy.max_interval, 1u);
+        }
+
+        if(!reachable_meshes.insert(me))
+            interval = min(interval, me->get_update_interval());
+        me->set_update_interval(interval, id);
+    });
+
+    ctx([&](entity id, transformable& t, rigid_animated& a){
+        uint32_t interval = get_animation_update_interval(
+            get_distance(t.get_global_position()), policy
+        );
+        a.set_update_interval(interval, id);
+    });
 }
 
+}
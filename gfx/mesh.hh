@@ -100,6 +100,27 @@ void play_all_mesh_animations(
 
 void update_mesh_animations(scene& ctx, time_ticks delta);
 
+struct animation_update_policy
+{
+    // Animations closer than this to a camera are applied on every update.
+    // Beyond that, the update interval doubles whenever the distance doubles.
+    float full_rate_distance = 10.0f;
+    uint32_t max_interval = 8;
+    // Models that no camera can see use max_interval.
+    bool throttle_offscreen = true;
+};
+
+// Sets the update intervals of all animated meshes and rigid_animated
+// entities based on their distance to the given cameras, e.g.
+// scene_stage::get_active_cameras(). Call this before updating the
+// animations. Phases are staggered by entity so that throttled animations
+// don't all apply on the same frame.
+void set_animation_update_intervals(
+    scene& ctx,
+    argvec<entity> cameras,
+    const animation_update_policy& policy = {}
+);
+
 }
 
 #endif
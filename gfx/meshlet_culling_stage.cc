@@ -0,0 +1,245 @@
+#include "meshlet_culling_stage.hh"
+#include "vulkan_helpers.hh"
+#include "primitive.hh"
+#include "model.hh"
+#include "meshlet_culling.comp.h"
+
+namespace
+{
+using namespace rb;
+using namespace rb::gfx;
+
+struct push_constant_buffer
+{
+    uint32_t entry_count;
+};
+
+// maxComputeWorkGroupCount[0] is guaranteed to be at least this.
+constexpr uint32_t max_dispatch_width = 65535;
+
+const primitive* get_entry_primitive(scene* s, const scene_stage::render_entry& entry)
+{
+    model& m = *s->get<model>(entry.id);
+    return (*m.m)[entry.vertex_group_index].get_primitive();
+}
+
+}
+
+namespace rb::gfx
+{
+
+meshlet_culling_stage::meshlet_culling_stage(
+    scene_stage& s,
+    const options& opt
+):  render_stage(s.get_device()),
+    opt(opt),
+    scene_data(&s),
+    stage_timer(s.get_device(), "meshlet culling"),
+    pipeline(s.get_device()),
+    descriptors(s.get_device()),
+    entry_buffer(s.get_device(), 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+    draw_capacity(0),
+    draw_count_capacity(0)
+{
+    RB_CHECK(
+        opt.view_group_size == 0 || opt.view_group_size > 32,
+        "view_group_size must be between 1 and 32."
+    );
+    RB_CHECK(
+        !dev->vulkan12_features.drawIndirectCount,
+        "Meshlet culling requires drawIndirectCount."
+    );
+    RB_CHECK(
+        !dev->physical_device_features.features.drawIndirectFirstInstance,
+        "Meshlet culling requires drawIndirectFirstInstance."
+    );
+
+    shader_data shader(meshlet_culling_comp_shader_binary);
+    descriptors.add(shader);
+    pipeline.init(
+        shader,
+        sizeof(push_constant_buffer),
+        {descriptors.get_layout(), scene_data->get_descriptor_set().get_layout()}
+    );
+}
+
+bool meshlet_culling_stage::get_indirect_draw(
+    uint32_t group_index,
+    size_t entry_index,
+    indirect_draw& draw
+) const {
+    if(group_index >= entry_lookup.size())
+        return false;
+    const std::vector<int32_t>& lookup = entry_lookup[group_index];
+    if(entry_index >= lookup.size() || lookup[entry_index] < 0)
+        return false;
+
+    const cull_entry& e = entries[lookup[entry_index]];
+    draw.draw_buffer = *draw_buffer;
+    draw.draw_offset = e.draw_offset * sizeof(VkDrawIndexedIndirectCommand);
+    draw.count_buffer = *draw_count_buffer;
+    draw.count_offset = lookup[entry_index] * sizeof(uint32_t);
+    draw.max_draw_count = e.meshlet_count;
+    return true;
+}
+
+uint32_t meshlet_culling_stage::get_view_group_size() const
+{
+    return opt.view_group_size;
+}
+
+scene_stage* meshlet_culling_stage::get_scene_data() const
+{
+    return scene_data;
+}
+
+void meshlet_culling_stage::update_buffers(uint32_t frame_index)
+{
+    clear_commands();
+    VkCommandBuffer cmd = compute_commands(true);
+    stage_timer.start(cmd, frame_index);
+
+    update_meshlet_table(cmd);
+
+    scene* s = scene_data->get_scene();
+    uint32_t camera_count = scene_data->get_active_cameras().size();
+    uint32_t group_count = (camera_count + opt.view_group_size - 1) / opt.view_group_size;
+    bool grouped = scene_data->get_camera_group_size() == opt.view_group_size;
+
+    entries.clear();
+    entry_lookup.resize(group_count);
+    uint32_t draw_count = 0;
+    for(uint32_t g = 0; g < group_count; ++g)
+    {
+        const auto& render_list = grouped ?
+            scene_data->get_camera_group_render_list(g) :
+            scene_data->get_render_list();
+        const std::vector<uint32_t>* visibility = grouped ?
+            &scene_data->get_camera_group_visibility(g) : nullptr;
+
+        std::vector<int32_t>& lookup = entry_lookup[g];
+        lookup.assign(render_list.size(), -1);
+        for(size_t i = 0; i < render_list.size(); ++i)
+        {
+            const primitive* prim = get_entry_primitive(s, render_list[i]);
+            auto it = meshlet_offsets.find(prim->get_unique_id());
+            if(it == meshlet_offsets.end())
+                continue;
+
+            cull_entry e;
+            e.instance_index = render_list[i].instance_index;
+            e.meshlet_offset = it->second;
+            e.meshlet_count = prim->get_meshlets().size();
+            e.draw_offset = draw_count;
+            e.camera_offset = g * opt.view_group_size;
+            e.camera_count = min(opt.view_group_size, camera_count - e.camera_offset);
+            e.view_mask = visibility ? (*visibility)[i] : 0xFFFFFFFFu;
+            e.pad = 0;
+            lookup[i] = entries.size();
+            entries.push_back(e);
+            draw_count += e.meshlet_count;
+        }
+    }
+
+    if(entries.size() != 0)
+    {
+        VkBufferUsageFlags usage =
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        if(draw_capacity < draw_count)
+        {
+            draw_capacity = draw_count * 2;
+            draw_buffer = create_gpu_buffer(
+                *dev, draw_capacity * sizeof(VkDrawIndexedIndirectCommand), usage
+            );
+        }
+        if(draw_count_capacity < entries.size())
+        {
+            draw_count_capacity = entries.size() * 2;
+            draw_count_buffer = create_gpu_buffer(
+                *dev, draw_count_capacity * sizeof(uint32_t), usage
+            );
+        }
+
+        entry_buffer.resize(entries.size() * sizeof(cull_entry));
+        entry_buffer.update_ptr(
+            frame_index, entries.data(), entries.size() * sizeof(cull_entry)
+        );
+        upload(cmd, &entry_buffer, frame_index);
+
+        descriptors.set_buffer("meshlets", *meshlet_buffer);
+        descriptors.set_buffer("entries", (VkBuffer)entry_buffer);
+        descriptors.set_buffer("draws", *draw_buffer);
+        descriptors.set_buffer("draw_counts", *draw_count_buffer);
+
+        pipeline.bind(cmd);
+        pipeline.push_descriptors(cmd, descriptors, 0);
+        pipeline.set_descriptors(cmd, scene_data->get_descriptor_set(), 0, 1);
+
+        push_constant_buffer pc;
+        pc.entry_count = entries.size();
+        pipeline.push_constants(cmd, &pc);
+
+        uint32_t width = min((uint32_t)entries.size(), max_dispatch_width);
+        pipeline.dispatch(
+            cmd, uvec3(width, (entries.size() + width - 1) / width, 1)
+        );
+
+        buffer_barrier(cmd, *draw_buffer);
+        buffer_barrier(cmd, *draw_count_buffer);
+        dev->gc.depend(*meshlet_buffer, cmd);
+        dev->gc.depend(*draw_buffer, cmd);
+        dev->gc.depend(*draw_count_buffer, cmd);
+    }
+
+    stage_timer.stop(cmd, frame_index);
+    use_compute_commands(cmd, frame_index);
+}
+
+void meshlet_culling_stage::update_meshlet_table(VkCommandBuffer cmd)
+{
+    // The table is only rebuilt when primitives with meshlets appear that it
+    // doesn't know yet. Rebuilding from the full render list also drops
+    // primitives that are no longer in the scene.
+    scene* s = scene_data->get_scene();
+    const auto& render_list = scene_data->get_render_list();
+    bool outdated = false;
+    for(const auto& entry: render_list)
+    {
+        const primitive* prim = get_entry_primitive(s, entry);
+        if(
+            prim->get_meshlets().size() != 0 &&
+            meshlet_offsets.count(prim->get_unique_id()) == 0
+        ){
+            outdated = true;
+            break;
+        }
+    }
+    if(!outdated)
+        return;
+
+    meshlet_offsets.clear();
+    std::vector<primitive::meshlet> meshlets;
+    for(const auto& entry: render_list)
+    {
+        const primitive* prim = get_entry_primitive(s, entry);
+        const std::vector<primitive::meshlet>& prim_meshlets = prim->get_meshlets();
+        if(prim_meshlets.size() == 0)
+            continue;
+        if(meshlet_offsets.emplace(prim->get_unique_id(), meshlets.size()).second)
+            meshlets.insert(meshlets.end(), prim_meshlets.begin(), prim_meshlets.end());
+    }
+
+    size_t bytes = meshlets.size() * sizeof(primitive::meshlet);
+    meshlet_buffer = create_gpu_buffer(
+        *dev, bytes,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT
+    );
+    vkres<VkBuffer> staging = create_staging_buffer(*dev, bytes, meshlets.data());
+    VkBufferCopy region = {0, 0, bytes};
+    vkCmdCopyBuffer(cmd, staging, *meshlet_buffer, 1, &region);
+    buffer_barrier(cmd, *meshlet_buffer);
+    dev->gc.depend(*staging, cmd);
+    dev->gc.depend(*meshlet_buffer, cmd);
+}
+
+}
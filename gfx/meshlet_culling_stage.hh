@@ -0,0 +1,94 @@
+#ifndef RAYBASE_GFX_MESHLET_CULLING_STAGE_HH
+#define RAYBASE_GFX_MESHLET_CULLING_STAGE_HH
+
+#include "scene_stage.hh"
+#include "compute_pipeline.hh"
+#include "gpu_buffer.hh"
+#include "timer.hh"
+#include <unordered_map>
+
+namespace rb::gfx
+{
+
+// Culls the meshlets of render list entries against each camera of a view
+// group on the GPU, and compacts the survivors into indirect draw arguments
+// for multiview_forward_stage. Each surviving meshlet is drawn once per view
+// group, with the bitmask of views that see it in firstInstance. Only
+// primitives created with build_meshlets are handled here, others are drawn
+// as usual.
+class meshlet_culling_stage: public render_stage
+{
+public:
+    struct options
+    {
+        // Must match multiview_forward_stage::options::max_view_group_size.
+        uint32_t view_group_size = 16;
+    };
+
+    meshlet_culling_stage(scene_stage& s, const options& opt);
+    meshlet_culling_stage(meshlet_culling_stage&&) = delete;
+
+    struct indirect_draw
+    {
+        VkBuffer draw_buffer;
+        VkDeviceSize draw_offset;
+        VkBuffer count_buffer;
+        VkDeviceSize count_offset;
+        uint32_t max_draw_count;
+    };
+
+    // entry_index is the index in the render list of the view group, as
+    // used by multiview_forward_stage. Returns false if the entry has no
+    // meshlets, in which case it must be drawn normally.
+    bool get_indirect_draw(
+        uint32_t group_index,
+        size_t entry_index,
+        indirect_draw& draw
+    ) const;
+
+    uint32_t get_view_group_size() const;
+    scene_stage* get_scene_data() const;
+
+protected:
+    void update_buffers(uint32_t frame_index) override;
+
+private:
+    void update_meshlet_table(VkCommandBuffer cmd);
+
+    struct cull_entry
+    {
+        uint32_t instance_index;
+        uint32_t meshlet_offset;
+        uint32_t meshlet_count;
+        uint32_t draw_offset;
+        uint32_t camera_offset;
+        uint32_t camera_count;
+        uint32_t view_mask;
+        uint32_t pad;
+    };
+
+    options opt;
+    scene_stage* scene_data;
+    timer stage_timer;
+    compute_pipeline pipeline;
+    push_descriptor_set descriptors;
+
+    // Meshlets of all known primitives are concatenated into one buffer,
+    // this maps primitive unique IDs to their first meshlet.
+    std::unordered_map<uint64_t, uint32_t> meshlet_offsets;
+    vkres<VkBuffer> meshlet_buffer;
+
+    std::vector<cull_entry> entries;
+    // Maps render list entries of each group to 'entries', -1 if the entry
+    // has no meshlets.
+    std::vector<std::vector<int32_t>> entry_lookup;
+    gpu_buffer entry_buffer;
+    vkres<VkBuffer> draw_buffer;
+    size_t draw_capacity;
+    vkres<VkBuffer> draw_count_buffer;
+    size_t draw_count_capacity;
+};
+
+}
+
+#endif
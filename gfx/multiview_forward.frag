@@ -12,7 +12,8 @@ layout(push_constant) uniform push_constant_buffer
 {
     uint instance_index;
     uint base_camera_index;
-    float pad[2];
+    uint view_mask;
+    uint instance_view_mask;
     rasterizer_config config;
 } pc;
 
@@ -20,7 +21,7 @@ layout(location = 0) out vec4 out_color;
 
 void main()
 {
-    instance inst = instances.array[pc.instance_index];
+    instance inst = instances.array[in_instance_index];
 
     vertex_data vd;
     material mat;
@@ -1,5 +1,7 @@
 #include "multiview_forward_stage.hh"
 #include "clustering_stage.hh"
+#include "meshlet_culling_stage.hh"
+#include "indirect_draw_stage.hh"
 #include "primitive.hh"
 #include "light.hh"
 #include "model.hh"
@@ -27,8 +29,14 @@ struct push_constant_buffer
 {
     uint32_t instance_index;
     uint32_t base_camera_index;
-    float pad[2];
+    uint32_t view_mask;
+    // Set for indirect meshlet draws, whose firstInstance is their view mask.
+    uint32_t instance_view_mask;
     rasterizer_config config;
+    pvec4 position_offset;
+    pvec4 position_scale;
+    // Texture UV offset in xy, scale in zw.
+    pvec4 uv_transform;
 };
 
 void set_stencil_params(raster_pipeline::params& params, const multiview_forward_stage::options& opt)
@@ -65,6 +73,138 @@ constexpr primitive::attribute_flag attributes =
         primitive::TANGENT |
         primitive::TEXTURE_UV |
         primitive::LIGHTMAP_UV;
+
+// Returns the attribute mask to draw the primitive with and sets up the
+// position dequantization for packed primitives.
+primitive::attribute_flag prepare_packed_draw(
+    const primitive* prim,
+    primitive::attribute_flag mask,
+    push_constant_buffer& pc
+){
+    if(!prim->is_packed())
+        return mask;
+    aabb range = prim->get_position_quantization_range();
+    pc.position_offset = vec4(range.min, 0);
+    pc.position_scale = vec4(range.max - range.min, 0);
+    vec4 uv_range = prim->get_texture_uv_quantization_range();
+    pc.uv_transform = vec4(
+        uv_range.x, uv_range.y, uv_range.z - uv_range.x, uv_range.w - uv_range.y
+    );
+    return primitive::get_packed_attributes(mask);
+}
+
+void draw_entry(
+    VkCommandBuffer cmd,
+    const primitive* prim,
+    primitive::attribute_flag mask,
+    const meshlet_culling_stage::indirect_draw* indirect
+){
+    if(indirect)
+    {
+        prim->draw_indirect(
+            cmd, mask, indirect->draw_buffer, indirect->draw_offset,
+            indirect->count_buffer, indirect->count_offset,
+            indirect->max_draw_count
+        );
+    }
+    else prim->draw(cmd, mask);
+}
+
+// Draws the render list entries in [begin, end). The push constants are
+// copied, so that parallel tasks can each use their own.
+void draw_entries(
+    VkCommandBuffer cmd,
+    scene* s,
+    const std::vector<scene_stage::render_entry>& render_list,
+    const std::vector<uint32_t>* visibility,
+    size_t begin,
+    size_t end,
+    uint32_t entry_mask,
+    const meshlet_culling_stage* meshlet_culling,
+    uint32_t group_index,
+    const descriptor_set& scene_set,
+    raster_pipeline& plain_pipeline,
+    raster_pipeline& packed_pipeline,
+    primitive::attribute_flag attribs,
+    bool opaque_only,
+    bool material_stencil,
+    push_constant_buffer pc
+){
+    raster_pipeline* bound = nullptr;
+    for(size_t i = begin; i < end; ++i)
+    {
+        const auto& entry = render_list[i];
+        if((entry.mask & entry_mask) == 0)
+            continue;
+        model& m = *s->get<model>(entry.id);
+        const material& mat = m.materials[entry.vertex_group_index];
+        if(opaque_only && mat.potentially_transparent())
+            continue;
+        const primitive* prim = (*m.m)[entry.vertex_group_index].get_primitive();
+
+        raster_pipeline* p = prim->is_packed() ? &packed_pipeline : &plain_pipeline;
+        if(p != bound)
+        {
+            p->bind(cmd);
+            p->set_descriptors(cmd, scene_set);
+            bound = p;
+        }
+
+        meshlet_culling_stage::indirect_draw indirect;
+        bool use_indirect = meshlet_culling &&
+            meshlet_culling->get_indirect_draw(group_index, i, indirect);
+        pc.instance_index = entry.instance_index;
+        pc.view_mask = visibility ? (*visibility)[i] : 0xFFFFFFFFu;
+        pc.instance_view_mask = use_indirect ? 1 : 0;
+        primitive::attribute_flag mask = prepare_packed_draw(prim, attribs, pc);
+        p->push_constants(cmd, &pc);
+
+        if(material_stencil)
+            vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
+        draw_entry(cmd, prim, mask, use_indirect ? &indirect : nullptr);
+    }
+}
+
+void draw_indirect_batches(
+    VkCommandBuffer cmd,
+    const indirect_draw_stage& indirect_draw,
+    uint32_t group_index,
+    const descriptor_set& scene_set,
+    raster_pipeline& plain_pipeline,
+    raster_pipeline& packed_pipeline,
+    primitive::attribute_flag attribs,
+    bool opaque_only,
+    bool material_stencil,
+    push_constant_buffer& pc
+){
+    // The instance index comes from firstInstance.
+    pc.instance_index = 0;
+    pc.view_mask = 0xFFFFFFFFu;
+    pc.instance_view_mask = 0;
+    const auto& batches = indirect_draw.get_batches();
+    raster_pipeline* bound = nullptr;
+    for(size_t i = 0; i < batches.size(); ++i)
+    {
+        const indirect_draw_stage::batch& b = batches[i];
+        if(opaque_only && b.potentially_transparent)
+            continue;
+
+        raster_pipeline* p = b.prim->is_packed() ? &packed_pipeline : &plain_pipeline;
+        if(p != bound)
+        {
+            p->bind(cmd);
+            p->set_descriptors(cmd, scene_set);
+            bound = p;
+        }
+        primitive::attribute_flag mask = prepare_packed_draw(b.prim, attribs, pc);
+        p->push_constants(cmd, &pc);
+
+        if(material_stencil)
+            vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, b.stencil_reference);
+        indirect_draw.draw(cmd, group_index, i, mask);
+    }
+}
+
 }
 
 namespace rb::gfx
@@ -81,6 +221,8 @@ multiview_forward_stage::multiview_forward_stage(
     pass(clustering.get_device()),
     z_pre_pass(clustering.get_device()),
     pipeline(clustering.get_device()),
+    packed_z_pre_pass(clustering.get_device()),
+    packed_pipeline(clustering.get_device()),
     stage_timer(clustering.get_device(), "multiview forward pass")
 {
     render_target* targets[] = {&color_buffer, &depth_buffer};
@@ -94,6 +236,21 @@ multiview_forward_stage::multiview_forward_stage(
     while((color_buffer.get_layer_count() % this->opt.max_view_group_size) != 0)
         this->opt.max_view_group_size--;
 
+    RB_CHECK(
+        opt.meshlet_culling &&
+        opt.meshlet_culling->get_view_group_size() != this->opt.max_view_group_size,
+        "Meshlet culling view group size must match the multiview group size."
+    );
+    RB_CHECK(
+        opt.indirect_draw &&
+        opt.indirect_draw->get_view_group_size() != this->opt.max_view_group_size,
+        "Indirect draw view group size must match the multiview group size."
+    );
+    RB_CHECK(
+        opt.indirect_draw && opt.meshlet_culling,
+        "Indirect draws and meshlet culling cannot be used together."
+    );
+
     std::vector<int32_t> view_offset(this->opt.max_view_group_size, 0);
     uint32_t view_mask = (1lu<<this->opt.max_view_group_size)-1;
     uint32_t view_masks[3] = {view_mask, view_mask, view_mask};
@@ -167,12 +324,42 @@ multiview_forward_stage::multiview_forward_stage(
         }
     }
 
-    unsigned subpass_index = 0;
-
-    if(opt.z_pre_pass)
+    for(bool packed: {false, true})
     {
-        auto bind_desc = primitive::get_bindings(primitive::POSITION);
-        auto attr_desc = primitive::get_attributes(primitive::POSITION);
+        unsigned subpass_index = 0;
+        if(opt.z_pre_pass)
+        {
+            primitive::attribute_flag mask = packed ?
+                primitive::get_packed_attributes(primitive::POSITION) :
+                primitive::POSITION;
+            auto bind_desc = primitive::get_bindings(mask);
+            auto attr_desc = primitive::get_attributes(mask);
+
+            raster_pipeline::params params(
+                pass, subpass_index++,
+                color_buffer.get_size(),
+                bind_desc.size(),
+                bind_desc.data(),
+                attr_desc.size(),
+                attr_desc.data()
+            );
+            set_stencil_params(params, opt);
+
+            raster_shader_data shader;
+            shader.vertex = multiview_z_pre_pass_vert_shader_binary;
+            shader.vertex.specialization[13] = packed ? 1 : 0;
+            shader.fragment = z_pre_pass_frag_shader_binary;
+
+            (packed ? packed_z_pre_pass : z_pre_pass).init(
+                params, shader, sizeof(push_constant_buffer),
+                scene_data->get_descriptor_set().get_layout()
+            );
+        }
+
+        primitive::attribute_flag mask = packed ?
+            primitive::get_packed_attributes(attributes) : attributes;
+        auto bind_desc = primitive::get_bindings(mask);
+        auto attr_desc = primitive::get_attributes(mask);
 
         raster_pipeline::params params(
             pass, subpass_index++,
@@ -185,38 +372,17 @@ multiview_forward_stage::multiview_forward_stage(
         set_stencil_params(params, opt);
 
         raster_shader_data shader;
-        shader.vertex = multiview_z_pre_pass_vert_shader_binary;
-        shader.fragment = z_pre_pass_frag_shader_binary;
-
-        z_pre_pass.init(
+        shader.vertex = multiview_forward_vert_shader_binary;
+        shader.vertex.specialization[13] = packed ? 1 : 0;
+        shader.fragment = multiview_forward_frag_shader_binary;
+        clustering.get_specialization_info(shader.fragment.specialization);
+        shader.fragment.specialization[11] = opt.dynamic_lighting ? 1 : 0;
+        shader.fragment.specialization[12] = opt.alpha_discard ? 1 : 0;
+        (packed ? packed_pipeline : pipeline).init(
             params, shader, sizeof(push_constant_buffer),
             scene_data->get_descriptor_set().get_layout()
         );
     }
-
-    auto bind_desc = primitive::get_bindings(attributes);
-    auto attr_desc = primitive::get_attributes(attributes);
-
-    raster_pipeline::params params(
-        pass, subpass_index++,
-        color_buffer.get_size(),
-        bind_desc.size(),
-        bind_desc.data(),
-        attr_desc.size(),
-        attr_desc.data()
-    );
-    set_stencil_params(params, opt);
-
-    raster_shader_data shader;
-    shader.vertex = multiview_forward_vert_shader_binary;
-    shader.fragment = multiview_forward_frag_shader_binary;
-    clustering.get_specialization_info(shader.fragment.specialization);
-    shader.fragment.specialization[11] = opt.dynamic_lighting ? 1 : 0;
-    shader.fragment.specialization[12] = opt.alpha_discard ? 1 : 0;
-    pipeline.init(
-        params, shader, sizeof(push_constant_buffer),
-        scene_data->get_descriptor_set().get_layout()
-    );
 }
 
 void multiview_forward_stage::update_buffers(uint32_t frame_index)
@@ -226,7 +392,7 @@ void multiview_forward_stage::update_buffers(uint32_t frame_index)
     stage_timer.start(cmd, frame_index);
 
     const auto& cameras = scene_data->get_active_cameras();
-    push_constant_buffer pc = {0, 0};
+    push_constant_buffer pc = {0, 0, 0xFFFFFFFFu, 0};
     scene* s = scene_data->get_scene();
 
     vec3 ambient = vec3(0);
@@ -235,57 +401,87 @@ void multiview_forward_stage::update_buffers(uint32_t frame_index)
     });
     pc.config.ambient = vec4(ambient, 0);
 
+    // If the scene culls cameras in groups matching our view groups, we can
+    // skip entries that no view sees and mask out views per entry.
+    bool grouped = scene_data->get_camera_group_size() == this->opt.max_view_group_size;
+    const descriptor_set& scene_set = scene_data->get_descriptor_set();
+    bool material_stencil = opt.enable_stencil && opt.use_material_stencil;
+    uint32_t group_index = 0;
+
     for(framebuffer& fb: framebuffers)
     {
-        pass.begin(cmd, fb);
-
-        if(opt.z_pre_pass)
-        {
-            z_pre_pass.bind(cmd);
-            z_pre_pass.set_descriptors(cmd, scene_data->get_descriptor_set());
-
-            for(auto& entry: scene_data->get_render_list())
+        const auto& render_list = grouped ?
+            scene_data->get_camera_group_render_list(group_index) :
+            scene_data->get_render_list();
+        const std::vector<uint32_t>* visibility = grouped ?
+            &scene_data->get_camera_group_visibility(group_index) : nullptr;
+
+        size_t task_count = 1;
+        if(opt.parallel_recording && !opt.indirect_draw)
+            task_count = get_parallel_task_count(render_list.size());
+        VkSubpassContents contents = task_count > 1 ?
+            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
+            VK_SUBPASS_CONTENTS_INLINE;
+
+        auto record = [&](
+            uint32_t subpass_index,
+            raster_pipeline& plain_pipeline,
+            raster_pipeline& packed_pipeline,
+            primitive::attribute_flag attribs,
+            bool opaque_only
+        ){
+            if(opt.indirect_draw)
             {
-                if((entry.mask & opt.mask) == 0)
-                    continue;
-                pc.instance_index = entry.instance_index;
-                z_pre_pass.push_constants(cmd, &pc);
-                model& m = *s->get<model>(entry.id);
-                const material& mat = m.materials[entry.vertex_group_index];
-
-                if(opt.enable_stencil && opt.use_material_stencil)
-                    vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
-                auto& vg = (*m.m)[entry.vertex_group_index];
-                if(!mat.potentially_transparent())
-                    vg.get_primitive()->draw(cmd, primitive::POSITION);
+                draw_indirect_batches(
+                    cmd, *opt.indirect_draw, group_index, scene_set,
+                    plain_pipeline, packed_pipeline, attribs,
+                    opaque_only, material_stencil, pc
+                );
             }
-
-            pass.next(cmd);
-        }
-
-        pipeline.bind(cmd);
-        pipeline.set_descriptors(cmd, scene_data->get_descriptor_set());
-
-        for(auto& entry: scene_data->get_render_list())
-        {
-            if((entry.mask & opt.mask) == 0)
-                continue;
-
-            pc.instance_index = entry.instance_index;
-            pipeline.push_constants(cmd, &pc);
-            model& m = *s->get<model>(entry.id);
-
-            if(opt.enable_stencil && opt.use_material_stencil)
+            else if(task_count > 1)
+            {
+                record_parallel_graphics(
+                    cmd, pass, subpass_index, fb, task_count,
+                    [&](VkCommandBuffer task_cmd, size_t task_index){
+                        size_t begin, end;
+                        get_parallel_task_range(
+                            render_list.size(), task_count, task_index, begin, end
+                        );
+                        draw_entries(
+                            task_cmd, s, render_list, visibility, begin, end,
+                            opt.mask, opt.meshlet_culling, group_index, scene_set,
+                            plain_pipeline, packed_pipeline, attribs,
+                            opaque_only, material_stencil, pc
+                        );
+                    }
+                );
+            }
+            else
             {
-                const material& mat = m.materials[entry.vertex_group_index];
-                vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, mat.stencil_reference);
+                draw_entries(
+                    cmd, s, render_list, visibility, 0, render_list.size(),
+                    opt.mask, opt.meshlet_culling, group_index, scene_set,
+                    plain_pipeline, packed_pipeline, attribs,
+                    opaque_only, material_stencil, pc
+                );
             }
+        };
 
-            (*m.m)[entry.vertex_group_index].get_primitive()->draw(cmd, attributes);
+        pass.begin(cmd, fb, contents);
+        uint32_t subpass_index = 0;
+        if(opt.z_pre_pass)
+        {
+            record(
+                subpass_index++, z_pre_pass, packed_z_pre_pass,
+                primitive::POSITION, true
+            );
+            pass.next(cmd, contents);
         }
-
+        record(subpass_index, pipeline, packed_pipeline, attributes, false);
         pass.end(cmd);
+
         pc.base_camera_index += this->opt.max_view_group_size;
+        group_index++;
     }
 
     stage_timer.stop(cmd, frame_index);
@@ -293,5 +489,3 @@ void multiview_forward_stage::update_buffers(uint32_t frame_index)
 }
 
 }
-
-
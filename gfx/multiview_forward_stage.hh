@@ -14,6 +14,8 @@ namespace rb::gfx
 
 class scene_stage;
 class clustering_stage;
+class meshlet_culling_stage;
+class indirect_draw_stage;
 
 // Like forward_stage, but renders into a texture array instead. It pulls the 
 class multiview_forward_stage: public render_stage
@@ -45,6 +47,23 @@ public:
         // to driver instabilities. 16 appears to be safe everywhere I've
         // tested.
         uint32_t max_view_group_size = 16;
+
+        // If set, entries whose primitives have meshlets are drawn with the
+        // indirect draws from this stage, which must run before this one.
+        // Its view_group_size must match max_view_group_size.
+        meshlet_culling_stage* meshlet_culling = nullptr;
+
+        // If set, draws come from this stage instead of the render lists, and
+        // its mask is used instead of the one above. It culls whole view
+        // groups, so views are not masked per instance. Its view_group_size
+        // must match max_view_group_size, and it cannot be combined with
+        // meshlet_culling.
+        indirect_draw_stage* indirect_draw = nullptr;
+
+        // Splits draw recording of each view group over the thread pool into
+        // secondary command buffers when its render list is large enough.
+        // Not used with indirect_draw.
+        bool parallel_recording = false;
     };
 
     multiview_forward_stage(
@@ -67,6 +86,8 @@ private:
     std::vector<vkres<VkImageView>> color_group_views;
 
     raster_pipeline z_pre_pass, pipeline;
+    // Variants for primitives with packed vertex attributes.
+    raster_pipeline packed_z_pre_pass, packed_pipeline;
     timer stage_timer;
 };
 
@@ -8,19 +8,42 @@
 #define RAYBASE_SCENE_SET 0
 #include "scene.glsl"
 
-layout(location = 0) in vec3 in_pos;
+// Set when drawing primitives with packed attributes.
+layout(constant_id = 13) const uint RB_PACKED_VERTICES = 0;
+
+layout(location = 0) in vec4 in_pos;
 
 layout(push_constant) uniform push_constant_buffer
 {
     uint instance_index;
     uint base_camera_index;
+    uint view_mask;
+    uint instance_view_mask;
+    layout(offset = 48) vec4 position_offset;
+    vec4 position_scale;
 } pc;
 
 void main()
 {
-    const instance inst = instances.array[pc.instance_index];
+    // Indirect draws pass either the view mask of a meshlet or the instance
+    // index in firstInstance.
+    uint instance_index = pc.instance_index;
+    uint view_mask = pc.view_mask;
+    if(pc.instance_view_mask != 0)
+        view_mask &= uint(gl_InstanceIndex);
+    else
+        instance_index += uint(gl_InstanceIndex);
+    const instance inst = instances.array[instance_index];
     const camera cam = cameras.array[pc.base_camera_index + gl_ViewIndex];
 
-    vec3 pos = (inst.model_to_world * vec4(in_pos, 1)).xyz;
+    vec3 pos = in_pos.xyz;
+    if(RB_PACKED_VERTICES != 0)
+        pos = pc.position_offset.xyz + pos * pc.position_scale.xyz;
+
+    pos = (inst.model_to_world * vec4(pos, 1)).xyz;
     gl_Position = cam.view_proj * vec4(pos, 1);
+    // Culled for this view, so move the whole primitive outside of the clip
+    // volume.
+    if((view_mask & (1u << gl_ViewIndex)) == 0)
+        gl_Position = vec4(2, 2, 2, 1);
 }
@@ -3,6 +3,374 @@
 #include "core/error.hh"
 #include <algorithm>
 #include <numeric>
+#include <unordered_map>
+#include <cstring>
+#include <type_traits>
+
+namespace
+{
+using namespace rb;
+using namespace rb::gfx;
+using vertex_data = primitive::vertex_data;
+
+template<typename F>
+void for_each_stream(vertex_data& vd, F&& f)
+{
+    f(vd.position);
+    f(vd.normal);
+    f(vd.tangent);
+    f(vd.texture_uv);
+    f(vd.lightmap_uv);
+    f(vd.joints);
+    f(vd.weights);
+    f(vd.color);
+}
+
+uint64_t hash_vertex(argvec<vertex_data*> sets, size_t vertex_count, uint32_t v)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(vertex_data* vd: sets)
+    {
+        for_each_stream(*vd, [&](auto& stream){
+            if(stream.size() != vertex_count) return;
+            const uint8_t* data = (const uint8_t*)&stream[v];
+            for(size_t i = 0; i < sizeof(stream[v]); ++i)
+            {
+                hash ^= data[i];
+                hash *= 0x100000001b3ull;
+            }
+        });
+    }
+    return hash;
+}
+
+bool vertices_equal(
+    argvec<vertex_data*> sets, size_t vertex_count, uint32_t a, uint32_t b
+){
+    bool equal = true;
+    for(vertex_data* vd: sets)
+    {
+        for_each_stream(*vd, [&](auto& stream){
+            if(equal && stream.size() == vertex_count)
+                equal = memcmp(&stream[a], &stream[b], sizeof(stream[a])) == 0;
+        });
+    }
+    return equal;
+}
+
+// Moves vertex i to remap[i]. Vertices with remap[i] == UINT32_MAX are dropped.
+void remap_vertices(
+    argvec<vertex_data*> sets,
+    size_t vertex_count,
+    const std::vector<uint32_t>& remap,
+    size_t new_vertex_count
+){
+    for(vertex_data* vd: sets)
+    {
+        for_each_stream(*vd, [&](auto& stream){
+            if(stream.size() != vertex_count) return;
+            std::remove_reference_t<decltype(stream)> new_stream(new_vertex_count);
+            for(size_t i = 0; i < vertex_count; ++i)
+                if(remap[i] != UINT32_MAX)
+                    new_stream[remap[i]] = stream[i];
+            stream = std::move(new_stream);
+        });
+    }
+}
+
+// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw" (Sander et al. 2007). Returns the new triangle order, and the
+// starting points of clusters that begin with a cache miss.
+std::vector<uint32_t> tipsify(
+    const std::vector<uint32_t>& index,
+    size_t vertex_count,
+    uint32_t cache_size,
+    std::vector<size_t>& cluster_starts
+){
+    size_t triangle_count = index.size() / 3;
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for(uint32_t i: index)
+        offsets[i+1]++;
+    for(size_t v = 0; v < vertex_count; ++v)
+        offsets[v+1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(index.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end()-1);
+    for(size_t i = 0; i < index.size(); ++i)
+        adjacency[fill[index[i]]++] = i / 3;
+
+    std::vector<uint32_t> live(vertex_count);
+    for(size_t v = 0; v < vertex_count; ++v)
+        live[v] = offsets[v+1] - offsets[v];
+
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;
+    order.reserve(triangle_count);
+
+    uint32_t time = cache_size + 1;
+    size_t cursor = 0;
+    int64_t fan = index[0];
+    cluster_starts.push_back(0);
+    while(fan >= 0)
+    {
+        candidates.clear();
+        for(uint32_t a = offsets[fan]; a < offsets[fan+1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if(emitted[t]) continue;
+            emitted[t] = true;
+            order.push_back(t);
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                uint32_t v = index[t*3+k];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if(time - cache_time[v] > cache_size)
+                {
+                    cache_time[v] = time;
+                    time++;
+                }
+            }
+        }
+
+        // Prefer vertices that will still be in the cache after their
+        // remaining triangles are emitted. Like in the paper, candidates
+        // without a positive priority are left to the dead-end stack.
+        int64_t best = -1;
+        int64_t best_priority = 0;
+        for(uint32_t v: candidates)
+        {
+            if(live[v] == 0) continue;
+            int64_t priority = 0;
+            if(time - cache_time[v] + 2 * live[v] <= cache_size)
+                priority = time - cache_time[v];
+            if(priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        while(best < 0 && !dead_end.empty())
+        {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if(live[v] > 0) best = v;
+        }
+
+        while(best < 0 && cursor < vertex_count)
+        {
+            if(live[cursor] > 0) best = cursor;
+            ++cursor;
+        }
+
+        if(
+            best >= 0 && order.size() < triangle_count &&
+            time - cache_time[best] > cache_size
+        ) cluster_starts.push_back(order.size());
+        fan = best;
+    }
+    return order;
+}
+
+// Sorts clusters so that those facing away from the center of the mesh are
+// drawn first, as they're most likely to occlude the rest.
+void sort_clusters_for_overdraw(
+    std::vector<uint32_t>& order,
+    const std::vector<size_t>& cluster_starts,
+    const std::vector<uint32_t>& index,
+    const std::vector<pvec3>& position
+){
+    struct cluster
+    {
+        size_t start;
+        size_t end;
+        vec3 centroid;
+        vec3 normal;
+        float area;
+        float sort_key;
+    };
+
+    std::vector<cluster> clusters(cluster_starts.size());
+    vec3 mesh_centroid = vec3(0);
+    float mesh_area = 0.0f;
+    for(size_t c = 0; c < clusters.size(); ++c)
+    {
+        cluster& cl = clusters[c];
+        cl.start = cluster_starts[c];
+        cl.end = c+1 < clusters.size() ? cluster_starts[c+1] : order.size();
+        cl.centroid = vec3(0);
+        cl.normal = vec3(0);
+        cl.area = 0.0f;
+        for(size_t i = cl.start; i < cl.end; ++i)
+        {
+            uint32_t t = order[i];
+            vec3 p0 = position[index[t*3+0]];
+            vec3 p1 = position[index[t*3+1]];
+            vec3 p2 = position[index[t*3+2]];
+            vec3 n = cross(p1-p0, p2-p0);
+            float area = length(n) * 0.5f;
+            cl.centroid += (p0 + p1 + p2) * (area / 3.0f);
+            cl.normal += n;
+            cl.area += area;
+        }
+        mesh_centroid += cl.centroid;
+        mesh_area += cl.area;
+        if(cl.area > 0.0f)
+            cl.centroid /= cl.area;
+    }
+    if(mesh_area > 0.0f)
+        mesh_centroid /= mesh_area;
+
+    for(cluster& cl: clusters)
+    {
+        float len = length(cl.normal);
+        cl.sort_key = len > 0.0f ?
+            dot(cl.centroid - mesh_centroid, cl.normal / len) : 0.0f;
+    }
+
+    std::stable_sort(
+        clusters.begin(), clusters.end(),
+        [](const cluster& a, const cluster& b){ return a.sort_key > b.sort_key; }
+    );
+
+    std::vector<uint32_t> new_order;
+    new_order.reserve(order.size());
+    for(const cluster& cl: clusters)
+        new_order.insert(new_order.end(), order.begin() + cl.start, order.begin() + cl.end);
+    order = std::move(new_order);
+}
+
+vec3 safe_normalize(vec3 v, vec3 fallback)
+{
+    float len = length(v);
+    return len > 0.0f ? v / len : fallback;
+}
+
+std::vector<uint8_t> pack_attribute(
+    const vertex_data& vd,
+    primitive::attribute_flag attribute,
+    aabb range,
+    vec4 uv_range,
+    size_t bytes
+){
+    std::vector<uint8_t> packed(bytes, 0);
+    size_t count = vd.get_vertex_count();
+    if(attribute == primitive::PACKED_POSITION)
+    {
+        vec3 scale = range.max - range.min;
+        vec3 inv_scale = vec3(
+            scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+            scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+            scale.z > 0.0f ? 1.0f / scale.z : 0.0f
+        );
+        uint64_t* out = reinterpret_cast<uint64_t*>(packed.data());
+        for(size_t i = 0; i < count; ++i)
+        {
+            vec3 p = (vec3(vd.position[i]) - range.min) * inv_scale;
+            uvec3 q = uvec3(round(clamp(p, vec3(0), vec3(1)) * 65535.0f));
+            out[i] = uint64_t(q.x) | (uint64_t(q.y) << 16) | (uint64_t(q.z) << 32);
+        }
+    }
+    else
+    {
+        uint32_t* out = reinterpret_cast<uint32_t*>(packed.data());
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(attribute == primitive::PACKED_NORMAL)
+            {
+                vec3 n = safe_normalize(vec3(vd.normal[i]), vec3(0, 0, 1));
+                out[i] = packSnorm2x16(octahedral_encode(n));
+            }
+            else if(attribute == primitive::PACKED_TANGENT)
+            {
+                // The bitangent sign is stored in the sign of the second
+                // component, whose value is remapped from [-1, 1] to
+                // [0.5, 1] to make room for it.
+                vec4 t = vec4(vd.tangent[i]);
+                vec2 e = octahedral_encode(safe_normalize(vec3(t), vec3(1, 0, 0)));
+                e.y = (e.y * 0.25f + 0.75f) * (t.w < 0.0f ? -1.0f : 1.0f);
+                out[i] = packSnorm2x16(e);
+            }
+            else if(attribute == primitive::PACKED_TEXTURE_UV)
+            {
+                // Like positions, relative to the range of the primitive, so
+                // that tiling UVs keep their precision.
+                vec2 scale = vec2(uv_range.z, uv_range.w) - vec2(uv_range);
+                vec2 inv_scale = vec2(
+                    scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+                    scale.y > 0.0f ? 1.0f / scale.y : 0.0f
+                );
+                vec2 uv = (vec2(vd.texture_uv[i]) - vec2(uv_range)) * inv_scale;
+                out[i] = packUnorm2x16(clamp(uv, vec2(0), vec2(1)));
+            }
+            else if(attribute == primitive::PACKED_LIGHTMAP_UV)
+                out[i] = packUnorm2x16(clamp(vec2(vd.lightmap_uv[i]), vec2(0), vec2(1)));
+        }
+    }
+    return packed;
+}
+
+primitive::meshlet create_meshlet(
+    const vertex_data& vd,
+    uint32_t first_index,
+    uint32_t index_count
+){
+    primitive::meshlet m;
+    m.first_index = first_index;
+    m.index_count = index_count;
+
+    vec3 min_pos = vec3(FLT_MAX);
+    vec3 max_pos = vec3(-FLT_MAX);
+    vec3 normal_sum = vec3(0);
+    for(uint32_t i = first_index; i < first_index + index_count; i += 3)
+    {
+        vec3 p0 = vec3(vd.position[vd.index[i]]);
+        vec3 p1 = vec3(vd.position[vd.index[i+1]]);
+        vec3 p2 = vec3(vd.position[vd.index[i+2]]);
+        min_pos = min(min_pos, min(p0, min(p1, p2)));
+        max_pos = max(max_pos, max(p0, max(p1, p2)));
+        normal_sum += safe_normalize(cross(p1 - p0, p2 - p0), vec3(0));
+    }
+
+    vec3 center = (min_pos + max_pos) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t i = first_index; i < first_index + index_count; ++i)
+        radius = max(radius, distance(center, vec3(vd.position[vd.index[i]])));
+    m.center = pvec3(center);
+    m.radius = radius;
+
+    // The cone contains all triangle normals. If they spread too much, the
+    // cone is disabled with a cutoff that can never pass.
+    vec3 axis = safe_normalize(normal_sum, vec3(0));
+    float min_dp = length(axis) > 0.0f ? 1.0f : -1.0f;
+    for(uint32_t i = first_index; i < first_index + index_count && min_dp > 0.0f; i += 3)
+    {
+        vec3 p0 = vec3(vd.position[vd.index[i]]);
+        vec3 p1 = vec3(vd.position[vd.index[i+1]]);
+        vec3 p2 = vec3(vd.position[vd.index[i+2]]);
+        vec3 n = cross(p1 - p0, p2 - p0);
+        if(length(n) > 0.0f)
+            min_dp = min(min_dp, dot(normalize(n), axis));
+    }
+    if(min_dp <= 0.1f)
+    {
+        m.cone_axis = pvec3(0);
+        m.cone_cutoff = 1.0f;
+    }
+    else
+    {
+        m.cone_axis = pvec3(axis);
+        m.cone_cutoff = sqrt(1.0f - min_dp * min_dp);
+    }
+    return m;
+}
+
+}
 
 namespace rb::gfx
 {
@@ -134,6 +502,119 @@ void primitive::vertex_data::ensure_attributes(attribute_flag mask)
     }
 }
 
+void primitive::vertex_data::optimize(
+    bool optimize_overdraw,
+    argvec<vertex_data*> related
+){
+    size_t vertex_count = get_vertex_count();
+    if(vertex_count == 0 || index.size() < 3 || index.size() % 3 != 0)
+        return;
+
+    std::vector<vertex_data*> sets = {this};
+    sets.insert(sets.end(), related.begin(), related.end());
+
+    // Deduplicate vertices. Exporters often split vertices for attributes
+    // that end up identical, which defeats the post-transform cache.
+    std::vector<uint32_t> remap(vertex_count);
+    std::unordered_multimap<uint64_t, uint32_t> unique_vertices;
+    size_t unique_count = 0;
+    for(uint32_t v = 0; v < vertex_count; ++v)
+    {
+        uint64_t hash = hash_vertex(sets, vertex_count, v);
+        auto range = unique_vertices.equal_range(hash);
+        bool found = false;
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(vertices_equal(sets, vertex_count, it->second, v))
+            {
+                remap[v] = remap[it->second];
+                found = true;
+                break;
+            }
+        }
+        if(!found)
+        {
+            remap[v] = unique_count++;
+            unique_vertices.emplace(hash, v);
+        }
+    }
+    if(unique_count < vertex_count)
+    {
+        remap_vertices(sets, vertex_count, remap, unique_count);
+        for(uint32_t& i: index)
+            i = remap[i];
+        vertex_count = unique_count;
+    }
+
+    // Reorder triangles for the post-transform vertex cache.
+    std::vector<size_t> cluster_starts;
+    std::vector<uint32_t> order = tipsify(index, vertex_count, 16, cluster_starts);
+    if(optimize_overdraw && position.size() == vertex_count)
+        sort_clusters_for_overdraw(order, cluster_starts, index, position);
+
+    std::vector<uint32_t> new_index(index.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        for(size_t k = 0; k < 3; ++k)
+            new_index[i*3+k] = index[order[i]*3+k];
+    index = std::move(new_index);
+
+    // Reorder vertices in order of first use for vertex fetch locality. This
+    // also drops unreferenced vertices.
+    std::vector<uint32_t> fetch_remap(vertex_count, UINT32_MAX);
+    uint32_t fetch_count = 0;
+    for(uint32_t& i: index)
+    {
+        if(fetch_remap[i] == UINT32_MAX)
+            fetch_remap[i] = fetch_count++;
+        i = fetch_remap[i];
+    }
+    remap_vertices(sets, vertex_count, fetch_remap, fetch_count);
+}
+
+std::vector<primitive::meshlet> primitive::vertex_data::build_meshlets() const
+{
+    std::vector<meshlet> meshlets;
+    if(position.size() == 0)
+        return meshlets;
+
+    // Vertices are marked with the index of the last meshlet they were
+    // added to, so membership checks are O(1).
+    std::vector<uint32_t> vertex_meshlet(position.size(), UINT32_MAX);
+    uint32_t cur = 0;
+    uint32_t first_index = 0;
+    uint32_t vertex_count = 0;
+    uint32_t triangle_count = 0;
+    auto count_new_vertices = [&](uint32_t t){
+        uint32_t a = index[t], b = index[t+1], c = index[t+2];
+        return uint32_t(vertex_meshlet[a] != cur) +
+            uint32_t(vertex_meshlet[b] != cur && b != a) +
+            uint32_t(vertex_meshlet[c] != cur && c != a && c != b);
+    };
+
+    for(uint32_t t = 0; t + 2 < index.size(); t += 3)
+    {
+        uint32_t new_vertices = count_new_vertices(t);
+        if(
+            vertex_count + new_vertices > MESHLET_MAX_VERTICES ||
+            triangle_count + 1 > MESHLET_MAX_TRIANGLES
+        ){
+            meshlets.push_back(create_meshlet(*this, first_index, t - first_index));
+            cur++;
+            first_index = t;
+            vertex_count = 0;
+            triangle_count = 0;
+            new_vertices = count_new_vertices(t);
+        }
+        for(uint32_t i = t; i < t + 3; ++i)
+            vertex_meshlet[index[i]] = cur;
+        vertex_count += new_vertices;
+        triangle_count++;
+    }
+    if(triangle_count != 0)
+        meshlets.push_back(create_meshlet(*this, first_index, triangle_count * 3));
+    return meshlets;
+}
+
 primitive::attribute_flag
 primitive::vertex_data::get_available_attributes() const
 {
@@ -184,19 +665,47 @@ void* primitive::vertex_data::get_attribute_data(attribute_flag attribute) const
 primitive::primitive(
     device& dev,
     vertex_data&& data,
-    bool opaque
+    bool opaque,
+    bool pack_attributes,
+    bool build_meshlets
 ):  async_loadable_resource(dev)
 {
     super_impl_data* d = &impl(false);
     d->source = nullptr;
     d->opaque = opaque;
+    d->packed = pack_attributes;
     d->data = std::move(data);
     d->has_bounding_box = false;
     d->unique_id = id_counter++;
     d->alignment =
         dev.physical_device_props.properties.limits.minStorageBufferOffsetAlignment;
-    async_load([d](){
+    async_load([d, build_meshlets](){
         d->available_attributes = d->data.get_available_attributes();
+        if(build_meshlets)
+            d->meshlets = d->data.build_meshlets();
+        if(d->packed)
+        {
+            d->available_attributes |= get_packed_attributes(
+                d->available_attributes
+            ) & ~d->available_attributes;
+            pvec3 min_pos(FLT_MAX);
+            pvec3 max_pos(-FLT_MAX);
+            for(pvec3 pos: d->data.position)
+            {
+                min_pos = min(pos, min_pos);
+                max_pos = max(pos, max_pos);
+            }
+            d->quantization_range = aabb{min_pos, max_pos};
+
+            pvec2 min_uv(FLT_MAX);
+            pvec2 max_uv(-FLT_MAX);
+            for(pvec2 uv: d->data.texture_uv)
+            {
+                min_uv = min(uv, min_uv);
+                max_uv = max(uv, max_uv);
+            }
+            d->uv_quantization_range = vec4(min_uv, max_uv);
+        }
 
         size_t vertex_buf_size = d->get_attribute_size(ALL_ATTRIBS);
         size_t index_buf_size = d->data.index.size() * sizeof(uint32_t);
@@ -241,6 +750,15 @@ primitive::primitive(
                 void* ptr = d->data.get_attribute_data(i);
                 size_t bytes = d->get_attribute_size(i);
                 size_t offset = d->get_attribute_offset(i);
+                std::vector<uint8_t> packed;
+                if(!ptr)
+                {
+                    packed = pack_attribute(
+                        d->data, i, d->quantization_range,
+                        d->uv_quantization_range, bytes
+                    );
+                    ptr = packed.data();
+                }
                 vkres<VkBuffer> staging = create_staging_buffer(*d->dev, bytes, ptr);
                 VkBufferCopy region = {0, offset, bytes};
                 vkCmdCopyBuffer(cmd, staging, d->vertex_buffer, 1, &region);
@@ -257,6 +775,7 @@ primitive::primitive(const primitive* source):
     super_impl_data* d = &impl(false);
     d->source = source;
     d->opaque = source->impl(false).opaque;
+    d->packed = false;
     d->has_bounding_box = source->get_bounding_box(d->bounding_box);
     d->unique_id = id_counter++;
     d->alignment = source->impl(false).alignment;
@@ -367,6 +886,21 @@ bool primitive::is_opaque() const
     return impl().opaque;
 }
 
+bool primitive::is_packed() const
+{
+    return impl().packed;
+}
+
+aabb primitive::get_position_quantization_range() const
+{
+    return impl().quantization_range;
+}
+
+vec4 primitive::get_texture_uv_quantization_range() const
+{
+    return impl().uv_quantization_range;
+}
+
 aabb primitive::calculate_bounding_box() const
 {
     pvec3 min_pos(FLT_MAX);
@@ -482,6 +1016,19 @@ size_t primitive::impl_data::get_attribute_size(attribute_flag attribute) const
     if(attribute&PREV_POSITION)
         add_aligned(sizeof(data.position[0]) * data.position.size());
 
+    // Packed attributes only take space if they were actually created.
+    attribute_flag packed_attributes = attribute & available_attributes;
+    if(packed_attributes&PACKED_POSITION)
+        add_aligned(sizeof(uint64_t) * data.position.size());
+    if(packed_attributes&PACKED_NORMAL)
+        add_aligned(sizeof(uint32_t) * data.normal.size());
+    if(packed_attributes&PACKED_TANGENT)
+        add_aligned(sizeof(uint32_t) * data.tangent.size());
+    if(packed_attributes&PACKED_TEXTURE_UV)
+        add_aligned(sizeof(uint32_t) * data.texture_uv.size());
+    if(packed_attributes&PACKED_LIGHTMAP_UV)
+        add_aligned(sizeof(uint32_t) * data.lightmap_uv.size());
+
     return size;
 }
 
@@ -522,11 +1069,12 @@ const primitive::vertex_data& primitive::get_vertex_data() const
     return impl().data;
 }
 
-void primitive::draw(
-    VkCommandBuffer buf,
-    attribute_flag mask,
-    uint32_t num_instances
-) const
+const std::vector<primitive::meshlet>& primitive::get_meshlets() const
+{
+    return impl().meshlets;
+}
+
+void primitive::bind(VkCommandBuffer buf, attribute_flag mask) const
 {
     RB_CHECK(!has_attribute(mask), "Some requested attributes do not exist.");
     auto& im = impl();
@@ -548,18 +1096,66 @@ void primitive::draw(
     if(index_buffer)
     {
         vkCmdBindIndexBuffer(buf, index_buffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(buf, get_index_count(), num_instances, 0, 0, 0);
         dev->gc.depend(index_buffer, buf);
     }
+
+    dev->gc.depend(*im.vertex_buffer, buf);
+    if(im.source)
+        dev->gc.depend(*im.source->impl().vertex_buffer, buf);
+}
+
+void primitive::draw(
+    VkCommandBuffer buf,
+    attribute_flag mask,
+    uint32_t num_instances
+) const
+{
+    bind(buf, mask);
+    if(get_index_buffer())
+        vkCmdDrawIndexed(buf, get_index_count(), num_instances, 0, 0, 0);
     else
     {
         RB_PANIC("Unindexed geometry! This won't work with ray tracing!");
         vkCmdDraw(buf, get_vertex_count(), num_instances, 0, 0);
     }
+}
 
-    dev->gc.depend(*im.vertex_buffer, buf);
-    if(im.source)
-        dev->gc.depend(*im.source->impl().vertex_buffer, buf);
+void primitive::draw_indirect(
+    VkCommandBuffer buf,
+    attribute_flag mask,
+    VkBuffer draw_buffer,
+    VkDeviceSize draw_offset,
+    VkBuffer count_buffer,
+    VkDeviceSize count_offset,
+    uint32_t max_draw_count
+) const
+{
+    RB_CHECK(!get_index_buffer(), "Indirect draws require indexed geometry.");
+    bind(buf, mask);
+    vkCmdDrawIndexedIndirectCount(
+        buf, draw_buffer, draw_offset, count_buffer, count_offset,
+        max_draw_count, sizeof(VkDrawIndexedIndirectCommand)
+    );
+    dev->gc.depend(draw_buffer, buf);
+    dev->gc.depend(count_buffer, buf);
+}
+
+primitive::attribute_flag
+primitive::get_packed_attributes(attribute_flag mask)
+{
+    constexpr std::pair<attribute_flag, attribute_flag> packable[] = {
+        {POSITION, PACKED_POSITION},
+        {NORMAL, PACKED_NORMAL},
+        {TANGENT, PACKED_TANGENT},
+        {TEXTURE_UV, PACKED_TEXTURE_UV},
+        {LIGHTMAP_UV, PACKED_LIGHTMAP_UV}
+    };
+    for(auto [full, packed]: packable)
+    {
+        if(mask&full)
+            mask = (mask & ~full) | packed;
+    }
+    return mask;
 }
 
 std::vector<VkVertexInputBindingDescription>
@@ -585,6 +1181,16 @@ primitive::get_bindings(attribute_flag mask)
         res.push_back({index++, sizeof(vertex_data().color[0]), VK_VERTEX_INPUT_RATE_VERTEX});
     if(mask&PREV_POSITION)
         res.push_back({index++, sizeof(vertex_data().position[0]), VK_VERTEX_INPUT_RATE_VERTEX});
+    if(mask&PACKED_POSITION)
+        res.push_back({index++, sizeof(uint64_t), VK_VERTEX_INPUT_RATE_VERTEX});
+    if(mask&PACKED_NORMAL)
+        res.push_back({index++, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_VERTEX});
+    if(mask&PACKED_TANGENT)
+        res.push_back({index++, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_VERTEX});
+    if(mask&PACKED_TEXTURE_UV)
+        res.push_back({index++, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_VERTEX});
+    if(mask&PACKED_LIGHTMAP_UV)
+        res.push_back({index++, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_VERTEX});
     return res;
 }
 
@@ -638,6 +1244,31 @@ primitive::get_attributes(attribute_flag mask)
         res.push_back({index, index, VK_FORMAT_R32G32B32_SFLOAT, 0});
         index++;
     }
+    if(mask&PACKED_POSITION)
+    {
+        res.push_back({index, index, VK_FORMAT_R16G16B16A16_UNORM, 0});
+        index++;
+    }
+    if(mask&PACKED_NORMAL)
+    {
+        res.push_back({index, index, VK_FORMAT_R16G16_SNORM, 0});
+        index++;
+    }
+    if(mask&PACKED_TANGENT)
+    {
+        res.push_back({index, index, VK_FORMAT_R16G16_SNORM, 0});
+        index++;
+    }
+    if(mask&PACKED_TEXTURE_UV)
+    {
+        res.push_back({index, index, VK_FORMAT_R16G16_UNORM, 0});
+        index++;
+    }
+    if(mask&PACKED_LIGHTMAP_UV)
+    {
+        res.push_back({index, index, VK_FORMAT_R16G16_UNORM, 0});
+        index++;
+    }
     return res;
 }
 
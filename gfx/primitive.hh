@@ -5,6 +5,7 @@
 #include "vkres.hh"
 #include "resource_loader.hh"
 #include "core/math.hh"
+#include "core/argvec.hh"
 #include <vector>
 
 namespace rb::gfx
@@ -23,8 +24,36 @@ public:
     static constexpr attribute_flag WEIGHTS = 1<<6;
     static constexpr attribute_flag COLOR = 1<<7;
     static constexpr attribute_flag PREV_POSITION = 1<<8;
+    // Packed variants of the attributes above, only present if the primitive
+    // was created with pack_attributes. Positions are unorm16 relative to
+    // get_position_quantization_range(), texture UVs are unorm16 relative to
+    // get_texture_uv_quantization_range(), normals and tangents are
+    // octahedral snorm16 (tangent sign folded into the second component) and
+    // lightmap UVs are unorm16.
+    static constexpr attribute_flag PACKED_POSITION = 1<<9;
+    static constexpr attribute_flag PACKED_NORMAL = 1<<10;
+    static constexpr attribute_flag PACKED_TANGENT = 1<<11;
+    static constexpr attribute_flag PACKED_TEXTURE_UV = 1<<12;
+    static constexpr attribute_flag PACKED_LIGHTMAP_UV = 1<<13;
     static constexpr attribute_flag ALL_ATTRIBS = 0xFFFFFFFF;
 
+    // A cluster of at most MESHLET_MAX_VERTICES unique vertices and
+    // MESHLET_MAX_TRIANGLES triangles, stored as a contiguous range of the
+    // index buffer. The bounds are in model space. A meshlet is back-facing
+    // from 'eye' if
+    // dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius.
+    struct meshlet
+    {
+        pvec3 center;
+        float radius;
+        pvec3 cone_axis;
+        float cone_cutoff;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+    static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+    static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
     struct vertex_data
     {
         // If left empty, you should call ensure_attributes(0) to create indices
@@ -47,6 +76,23 @@ public:
         // placeholder values. Note that position cannot be filled in and is
         // assumed to exist when this is called.
         void ensure_attributes(attribute_flag mask);
+
+        // Deduplicates vertices and reorders triangles and vertices for
+        // post-transform cache and vertex fetch locality. With
+        // optimize_overdraw, clusters of triangles are also sorted so that
+        // outward-facing ones are drawn first. Morph targets must be given
+        // in 'related', they're reordered along with this vertex data.
+        // Requires a triangle list index buffer.
+        void optimize(
+            bool optimize_overdraw = false,
+            argvec<vertex_data*> related = {}
+        );
+
+        // Splits the triangle list into meshlets in index order, so call this
+        // after optimize() for tighter clusters. Requires a triangle list
+        // index buffer.
+        std::vector<meshlet> build_meshlets() const;
+
         attribute_flag get_available_attributes() const;
         size_t get_vertex_count() const;
         void* get_attribute_data(attribute_flag attribute) const;
@@ -55,7 +101,15 @@ public:
     primitive(
         device& dev,
         vertex_data&& data,
-        bool opaque = true
+        bool opaque = true,
+        // Also uploads packed copies of the position, normal, tangent and UV
+        // streams for rasterization. The full-precision streams are still
+        // needed for ray tracing and animation, so they're kept: this reduces
+        // vertex fetch bandwidth, but increases the memory use of the vertex
+        // buffer by 24 bytes per vertex.
+        bool pack_attributes = false,
+        // Builds meshlets for cluster culling, see meshlet_culling_stage.
+        bool build_meshlets = false
     );
     // This constructor is for creating animation copies.
     primitive(const primitive* source);
@@ -69,6 +123,12 @@ public:
     VkDeviceAddress get_index_buffer_address() const;
 
     bool is_opaque() const;
+    bool is_packed() const;
+
+    // Packed positions are dequantized as min + value * (max - min).
+    aabb get_position_quantization_range() const;
+    // Same for packed texture UVs, with min in xy and max in zw.
+    vec4 get_texture_uv_quantization_range() const;
 
     aabb calculate_bounding_box() const;
     void set_bounding_box(aabb bounding_box);
@@ -83,6 +143,12 @@ public:
     attribute_flag get_available_attributes() const;
 
     const vertex_data& get_vertex_data() const;
+    // Empty unless the primitive was created with build_meshlets. Animation
+    // copies never have meshlets, as their bounds would be stale.
+    const std::vector<meshlet>& get_meshlets() const;
+
+    // Binds the vertex buffers of the masked attributes and the index buffer.
+    void bind(VkCommandBuffer buf, attribute_flag mask) const;
 
     void draw(
         VkCommandBuffer buf,
@@ -90,6 +156,22 @@ public:
         uint32_t num_instances = 1
     ) const;
 
+    // Draws with VkDrawIndexedIndirectCommands that refer to this
+    // primitive's index buffer, such as those from meshlet culling.
+    void draw_indirect(
+        VkCommandBuffer buf,
+        attribute_flag mask,
+        VkBuffer draw_buffer,
+        VkDeviceSize draw_offset,
+        VkBuffer count_buffer,
+        VkDeviceSize count_offset,
+        uint32_t max_draw_count
+    ) const;
+
+    // Replaces attributes in the mask with their packed variants, where such
+    // exist.
+    static attribute_flag get_packed_attributes(attribute_flag mask);
+
     static std::vector<VkVertexInputBindingDescription>
     get_bindings(attribute_flag mask);
 
@@ -102,9 +184,13 @@ public:
     {
         const primitive* source;
         bool opaque;
+        bool packed;
         vertex_data data;
         bool has_bounding_box;
         aabb bounding_box;
+        aabb quantization_range;
+        vec4 uv_quantization_range;
+        std::vector<meshlet> meshlets;
         size_t alignment;
         attribute_flag available_attributes;
         vkres<VkBuffer> vertex_buffer;
@@ -218,6 +218,18 @@ void radix_sort::get_sort_index(
     );
 }
 
+void radix_sort::place(
+    VkCommandBuffer cmd,
+    VkBuffer payload,
+    VkBuffer sorted_keyvals,
+    VkBuffer output,
+    size_t payload_size,
+    size_t count
+){
+    keyvals_sorted = {sorted_keyvals, 0, VK_WHOLE_SIZE};
+    resort(cmd, payload, output, payload_size, count);
+}
+
 void radix_sort::resort(
     VkCommandBuffer cmd,
     VkBuffer payload,
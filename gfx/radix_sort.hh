@@ -34,6 +34,18 @@ public:
         size_t count
     );
 
+    // Skips sorting and places the payload according to the given, already
+    // sorted keyvals (uvec2(source index, key) pairs). After this, the given
+    // order is also used by get_sort_index() and resort().
+    void place(
+        VkCommandBuffer cmd,
+        VkBuffer payload,
+        VkBuffer sorted_keyvals,
+        VkBuffer output,
+        size_t payload_size,
+        size_t count
+    );
+
     // Using the sort order from the previous sort(), sort another buffer.
     // Use it as a last _resort_ ;)
     void resort(
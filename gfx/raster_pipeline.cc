@@ -126,8 +126,61 @@ void raster_pipeline::init(
     size_t push_constant_size,
     argvec<VkDescriptorSetLayout> sets
 ){
-    params create_params = p;
+    // Everything the create infos point to usually lives on the caller's
+    // stack, so the deferred compilation needs its own copies.
+    const VkPipelineVertexInputStateCreateInfo& vi = p.vertex_input_info;
+    std::vector<VkVertexInputBindingDescription> bindings(
+        vi.pVertexBindingDescriptions,
+        vi.pVertexBindingDescriptions + vi.vertexBindingDescriptionCount
+    );
+    std::vector<VkVertexInputAttributeDescription> attributes(
+        vi.pVertexAttributeDescriptions,
+        vi.pVertexAttributeDescriptions + vi.vertexAttributeDescriptionCount
+    );
+    std::vector<VkDynamicState> dynamic_states(
+        p.dynamic_info.pDynamicStates,
+        p.dynamic_info.pDynamicStates + p.dynamic_info.dynamicStateCount
+    );
+    std::vector<VkSampleMask> sample_mask;
+    if(p.multisample_info.pSampleMask)
+    {
+        sample_mask.assign(
+            p.multisample_info.pSampleMask,
+            p.multisample_info.pSampleMask + (p.multisample_info.rasterizationSamples + 31) / 32
+        );
+    }
+
+    // Extension chains can't be copied generically, so those pipelines are
+    // compiled right away instead.
+    bool has_extensions =
+        vi.pNext ||
+        p.input_assembly_info.pNext ||
+        p.rasterization_info.pNext ||
+        p.multisample_info.pNext ||
+        p.depth_stencil_info.pNext ||
+        p.dynamic_info.pNext ||
+        p.conservative_rasterization_info.pNext;
 
+    compile([
+        this, p, sd, push_constant_size, bindings, attributes, dynamic_states, sample_mask,
+        sets = std::vector<VkDescriptorSetLayout>(sets.begin(), sets.end())
+    ](){
+        params create_params = p;
+        create_params.vertex_input_info.pVertexBindingDescriptions = bindings.data();
+        create_params.vertex_input_info.pVertexAttributeDescriptions = attributes.data();
+        create_params.dynamic_info.pDynamicStates = dynamic_states.data();
+        if(sample_mask.size() != 0)
+            create_params.multisample_info.pSampleMask = sample_mask.data();
+        create(create_params, sd, push_constant_size, sets);
+    }, !has_extensions);
+}
+
+void raster_pipeline::create(
+    params create_params,
+    const raster_shader_data& sd,
+    size_t push_constant_size,
+    argvec<VkDescriptorSetLayout> sets
+){
     // AMD Fix: MSAA is broken by default, so force sample shading with the matching minSampleShading
     if (dev->physical_device_props.properties.vendorID == 4098)
     {
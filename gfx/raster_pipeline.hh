@@ -51,12 +51,26 @@ public:
         std::vector<VkPipelineColorBlendAttachmentState> blend_states;
     };
 
+    // Within a parallel_compile_scope, compilation happens later on another
+    // thread. The vertex input descriptions, dynamic states, sample mask and
+    // blend states are copied, so they only need to live until init()
+    // returns. Pipelines with a pNext chain in any of the params' create
+    // infos are compiled immediately. The render pass and the shader binaries
+    // must stay alive until the scope ends.
     void init(
         const params& p,
         const raster_shader_data& program,
         size_t push_constant_size = 0,
         argvec<VkDescriptorSetLayout> sets = {}
     );
+
+private:
+    void create(
+        params create_params,
+        const raster_shader_data& sd,
+        size_t push_constant_size,
+        argvec<VkDescriptorSetLayout> sets
+    );
 };
 
 }
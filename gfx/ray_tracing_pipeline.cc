@@ -13,6 +13,19 @@ void ray_tracing_pipeline::init(
     const ray_tracing_shader_data& program,
     size_t push_constant_size,
     argvec<VkDescriptorSetLayout> sets
+){
+    compile([
+        this, program, push_constant_size,
+        sets = std::vector<VkDescriptorSetLayout>(sets.begin(), sets.end())
+    ](){
+        create(program, push_constant_size, sets);
+    });
+}
+
+void ray_tracing_pipeline::create(
+    const ray_tracing_shader_data& program,
+    size_t push_constant_size,
+    argvec<VkDescriptorSetLayout> sets
 ){
     std::vector<vkres<VkShaderModule>> shader_modules;
     std::vector<VkPipelineShaderStageCreateInfo> shader_infos;
@@ -233,6 +246,7 @@ void ray_tracing_pipeline::init(
 
 void ray_tracing_pipeline::trace_rays(VkCommandBuffer buf, uvec3 work_size)
 {
+    finish_compile();
     vkCmdTraceRaysKHR(
         buf, &gen_region, &miss_region, &hit_region, &call_region,
         work_size.x, work_size.y, work_size.z
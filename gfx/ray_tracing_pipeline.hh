@@ -38,6 +38,12 @@ public:
     void trace_rays(VkCommandBuffer buf, uvec3 work_size);
 
 private:
+    void create(
+        const ray_tracing_shader_data& program,
+        size_t push_constant_size,
+        argvec<VkDescriptorSetLayout> sets
+    );
+
     vkres<VkBuffer> sbt_buffer;
     VkStridedDeviceAddressRegionKHR gen_region;
     VkStridedDeviceAddressRegionKHR miss_region;
@@ -249,8 +249,11 @@ VkAttachmentDescription render_pass::get_attachment_description(
     return create_params.attachments[attachment_index];
 }
 
-void render_pass::begin(VkCommandBuffer buf, framebuffer& fb)
-{
+void render_pass::begin(
+    VkCommandBuffer buf,
+    framebuffer& fb,
+    VkSubpassContents contents
+){
     uvec2 size = fb.get_size();
     VkRenderPassBeginInfo render_pass_info = {
         VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -261,14 +264,14 @@ void render_pass::begin(VkCommandBuffer buf, framebuffer& fb)
         (uint32_t)create_params.clear_values.size(),
         create_params.clear_values.data()
     };
-    vkCmdBeginRenderPass(buf, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(buf, &render_pass_info, contents);
     dev->gc.depend((VkFramebuffer)fb, buf);
     dev->gc.depend(pass, buf);
 }
 
-void render_pass::next(VkCommandBuffer buf)
+void render_pass::next(VkCommandBuffer buf, VkSubpassContents contents)
 {
-    vkCmdNextSubpass(buf, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdNextSubpass(buf, contents);
 }
 
 void render_pass::end(VkCommandBuffer buf)
@@ -70,8 +70,17 @@ public:
     unsigned subpass_target_count(unsigned subpass_index) const;
     VkAttachmentDescription get_attachment_description(unsigned attachment_index) const;
 
-    void begin(VkCommandBuffer buf, framebuffer& fb);
-    void next(VkCommandBuffer buf);
+    // Use VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS for subpasses that are
+    // recorded with render_stage::record_parallel_graphics().
+    void begin(
+        VkCommandBuffer buf,
+        framebuffer& fb,
+        VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE
+    );
+    void next(
+        VkCommandBuffer buf,
+        VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE
+    );
     void end(VkCommandBuffer buf);
 
 private:
@@ -1,6 +1,7 @@
 #include "render_pipeline.hh"
 #include "vulkan_helpers.hh"
 #include "context.hh"
+#include "gpu_pipeline.hh"
 
 namespace rb::gfx
 {
@@ -34,6 +35,9 @@ void render_pipeline::reinit()
 {
     if(!output) return;
 
+    // Stages are built on this thread, but their pipelines get compiled in
+    // parallel, which is where most of the time goes.
+    gpu_pipeline::parallel_compile_scope compile_scope;
     render_target target = reset();
     pipeline_output_target = target;
     blit.emplace(output->get_device(), target, *output);
@@ -1,7 +1,11 @@
 #include "render_stage.hh"
 #include "vulkan_helpers.hh"
+#include "context.hh"
 #include "gpu_buffer.hh"
+#include "render_pass.hh"
+#include "framebuffer.hh"
 #include "core/stack_allocator.hh"
+#include <algorithm>
 
 namespace rb::gfx
 {
@@ -10,6 +14,7 @@ render_stage::render_stage(device& dev)
 : dev(&dev), first_frame(true)
 {
     command_buffers.resize(dev.get_in_flight_count());
+    command_hashes.resize(dev.get_in_flight_count());
     graphics_pool = dev.get_graphics_pool();
     compute_pool = dev.get_compute_pool();
     transfer_pool = dev.get_transfer_pool();
@@ -72,6 +77,88 @@ event render_stage::use_graphics_commands(VkCommandBuffer buf, uint32_t frame_in
     return dev->get_next_graphics_frame_event(command_buffers.size()-1);
 }
 
+void render_stage::record_parallel_graphics(
+    VkCommandBuffer primary,
+    const render_pass& pass,
+    uint32_t subpass_index,
+    const framebuffer& fb,
+    size_t task_count,
+    const std::function<void(VkCommandBuffer cmd, size_t task_index)>& record
+){
+    if(task_count == 0)
+        return;
+
+    VkCommandBufferInheritanceInfo inheritance_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        nullptr,
+        pass,
+        subpass_index,
+        fb,
+        VK_FALSE,
+        0,
+        0
+    };
+
+    // Command pools can't be shared between threads, so each task allocates
+    // from the pool of the thread it ends up running on.
+    auto secondaries = stack_allocate<vkres<VkCommandBuffer>>(task_count);
+    auto tasks = stack_allocate<std::function<void()>>(task_count);
+    for(size_t i = 0; i < task_count; ++i)
+    {
+        tasks[i] = [&, i](){
+            VkCommandPool pool = dev->get_graphics_pool();
+            VkCommandBuffer buf = dev->allocate_command_buffer(
+                pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY
+            );
+            VkCommandBufferBeginInfo begin_info = {
+                VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                nullptr,
+                VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT|
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                &inheritance_info
+            };
+            vkBeginCommandBuffer(buf, &begin_info);
+            {
+                // Dependencies are registered once per task, not per bind.
+                garbage_collector::batch_scope batch(dev->gc);
+                record(buf, i);
+            }
+            vkEndCommandBuffer(buf);
+            secondaries[i] = vkres<VkCommandBuffer>(*dev, pool, buf);
+        };
+    }
+    if(task_count == 1) tasks[0]();
+    else dev->ctx->get_thread_pool().add_tasks(tasks).wait();
+
+    auto bufs = stack_allocate<VkCommandBuffer>(task_count);
+    for(size_t i = 0; i < task_count; ++i)
+        bufs[i] = *secondaries[i];
+    // The secondary command buffers are released along with the primary.
+    dev->gc.depend_many(argvec<VkCommandBuffer>(bufs.get(), task_count).make_void_ptr(), primary);
+    vkCmdExecuteCommands(primary, task_count, bufs.get());
+}
+
+size_t render_stage::get_parallel_task_count(
+    size_t item_count,
+    size_t min_items_per_task
+) const {
+    size_t max_tasks = std::max(dev->ctx->get_thread_pool().get_thread_count(), (size_t)1);
+    return std::clamp(
+        item_count / std::max(min_items_per_task, (size_t)1), (size_t)1, max_tasks
+    );
+}
+
+void render_stage::get_parallel_task_range(
+    size_t item_count,
+    size_t task_count,
+    size_t task_index,
+    size_t& begin,
+    size_t& end
+){
+    begin = item_count * task_index / task_count;
+    end = item_count * (task_index + 1) / task_count;
+}
+
 VkCommandBuffer render_stage::transfer_commands(bool one_time_submit)
 {
     return commands(transfer_pool, one_time_submit);
@@ -168,6 +255,18 @@ void render_stage::clear_commands()
 {
     for(auto& cmds: command_buffers)
         cmds.clear();
+    for(auto& hash: command_hashes)
+        hash.reset();
+}
+
+bool render_stage::reuse_commands(uint32_t frame_index, size_t state_hash)
+{
+    if(command_hashes[frame_index] == state_hash)
+        return true;
+
+    command_buffers[frame_index].clear();
+    command_hashes[frame_index] = state_hash;
+    return false;
 }
 
 bool render_stage::has_commands() const
@@ -6,11 +6,15 @@
 #include "event.hh"
 #include "core/argvec.hh"
 #include <vector>
+#include <functional>
+#include <optional>
 
 namespace rb::gfx
 {
 
 class gpu_buffer;
+class render_pass;
+class framebuffer;
 class render_stage
 {
 public:
@@ -38,6 +42,38 @@ protected:
     VkCommandBuffer graphics_commands(bool one_time_submit = false);
     event use_graphics_commands(VkCommandBuffer buf, uint32_t frame_index);
 
+    // Records 'task_count' secondary command buffers in parallel on the
+    // thread pool, and executes them in order in 'primary'. 'primary' must be
+    // in the given subpass, begun with
+    // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Secondary command buffers
+    // inherit no state, so 'record' must bind its pipelines and descriptors
+    // again. Everything it calls must be thread-safe.
+    void record_parallel_graphics(
+        VkCommandBuffer primary,
+        const render_pass& pass,
+        uint32_t subpass_index,
+        const framebuffer& fb,
+        size_t task_count,
+        const std::function<void(VkCommandBuffer cmd, size_t task_index)>& record
+    );
+
+    // Picks the number of tasks to split 'item_count' draws into for
+    // record_parallel_graphics(). Returns 1 when splitting isn't worth it.
+    size_t get_parallel_task_count(
+        size_t item_count,
+        size_t min_items_per_task = 256
+    ) const;
+
+    // Gives the contiguous range [begin, end) of items for a task. The ranges
+    // of all tasks cover all items in order, so render list sorting is kept.
+    static void get_parallel_task_range(
+        size_t item_count,
+        size_t task_count,
+        size_t task_index,
+        size_t& begin,
+        size_t& end
+    );
+
     // Transfer pipelines only: (note that these can't be timed!)
     VkCommandBuffer transfer_commands(bool one_time_submit = false);
     event use_transfer_commands(VkCommandBuffer buf, uint32_t frame_index);
@@ -55,6 +91,17 @@ protected:
     void clear_commands();
     bool has_commands() const;
 
+    // Lets update_buffers() skip re-recording commands that would come out
+    // identical. Call it instead of clear_commands() with a hash of
+    // everything the commands depend on: item counts, resolutions, buffer
+    // handles, push constants and descriptor set versions. Returns true if
+    // the commands previously recorded for this frame_index had the same
+    // hash; they are then submitted again as-is. Otherwise, only the commands
+    // of this frame_index are cleared and you must record new ones with
+    // one_time_submit = false. Per-frame staging buffers are still copied by
+    // reused commands, so their contents can be updated every frame.
+    bool reuse_commands(uint32_t frame_index, size_t state_hash);
+
     device* dev;
 
 private:
@@ -67,6 +114,7 @@ private:
 
     bool first_frame;
     std::vector<std::vector<vkres<VkCommandBuffer>>> command_buffers;
+    std::vector<std::optional<size_t>> command_hashes;
     std::vector<event> wait_events;
 };
 
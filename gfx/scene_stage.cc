@@ -1,6 +1,8 @@
 #include "scene_stage.hh"
 #include "core/stack_allocator.hh"
+#include "core/sort.hh"
 #include "vulkan_helpers.hh"
+#include "context.hh"
 #include "clustering_stage.hh"
 #include "model.hh"
 #include "camera.hh"
@@ -451,6 +453,7 @@ scene_stage::scene_stage(device& dev, const options& opt)
 {
     RB_CHECK(opt.max_lights % 128u != 0, "max_lights must be divisible by 128.");
     RB_CHECK(opt.max_decals % 128u != 0, "max_decals must be divisible by 128.");
+    RB_CHECK(opt.camera_group_size > 32, "camera_group_size must be at most 32.");
     textures.reserve(opt.max_textures);
     samplers.reserve(opt.max_textures);
     envmap_textures.reserve(opt.max_envmaps);
@@ -660,6 +663,8 @@ const std::vector<scene_stage::render_entry>& scene_stage::get_render_list(
 ) const {
     (void)cull_camera_id;
     int32_t i = get_camera_index(cull_camera_id);
+    if(i >= 0 && opt.camera_group_size != 0)
+        return get_camera_group_render_list(i / opt.camera_group_size);
     if(i < 0 || i >= camera_render_list.size())
         return generic_render_list;
     return camera_render_list[i];
@@ -670,6 +675,30 @@ const std::vector<entity>& scene_stage::get_active_cameras() const
     return camera_indices;
 }
 
+uint32_t scene_stage::get_camera_group_size() const
+{
+    return opt.camera_group_size;
+}
+
+const std::vector<scene_stage::render_entry>& scene_stage::get_camera_group_render_list(
+    uint32_t group_index
+) const {
+    if(group_index >= camera_group_render_list.size())
+        return generic_render_list;
+    return camera_group_render_list[group_index];
+}
+
+const std::vector<uint32_t>& scene_stage::get_camera_group_visibility(
+    uint32_t group_index
+) const {
+    RB_CHECK(
+        group_index >= camera_group_visibility.size(),
+        "Camera group ", group_index, " does not exist. Is "
+        "scene_stage::options::camera_group_size set?"
+    );
+    return camera_group_visibility[group_index];
+}
+
 VkAccelerationStructureKHR scene_stage::get_tlas_handle() const
 {
     if(as_manager.has_value()) return as_manager->get_tlas();
@@ -696,6 +725,8 @@ void scene_stage::update_buffers(uint32_t frame_index)
     sampler_indices.clear();
     camera_indices.clear();
     generic_render_list.clear();
+    render_entry_bounds.clear();
+    render_entry_origins.clear();
     animated_mesh_indices.clear();
     for(auto& list: camera_render_list)
         list.clear();
@@ -774,12 +805,8 @@ void scene_stage::update_buffers(uint32_t frame_index)
 void scene_stage::add_instances(
     void* vdata,
     size_t& i,
-    argvec<frustum> camera_frusta,
     bool static_instances
 ){
-    auto camera_local_frusta = global_stack_allocator.allocate<frustum>(camera_count);
-    auto camera_local_depths = global_stack_allocator.allocate<float>(camera_count);
-
     bool tri_lights_enabled = opt.ray_tracing;
     gpu_instance* data = (gpu_instance*)vdata;
     instance_prev_map.resize(instance_count);
@@ -832,28 +859,6 @@ void scene_stage::add_instances(
             td->bounding_box = aabb_from_obb(bounding_box, t.get_global_transform());
         }
 
-        // Calculate local frusta if necessary
-        if(opt.frustum_culling && m.m && m.m->has_any_bounding_boxes())
-        {
-            for(size_t j = 0; j < camera_frusta.size(); ++j)
-            {
-                camera_local_frusta[j] = camera_frusta[j];
-                for(vec4& p: camera_local_frusta[j].planes)
-                    p = trans_mat * p;
-            }
-        }
-
-        // Pre-calculate approx depth for each camera (needed for depth
-        // sorting - all primitives in the model share same depth)
-        if(opt.depth_sort)
-        {
-            for(size_t j = 0; j < camera_frusta.size(); ++j)
-            {
-                camera_local_depths[j] =
-                    dot(camera_frusta[j].planes[5], vec4(pos, 1.0f));
-            }
-        }
-
         const auto& mt_weights = m.m->get_morph_target_weights();
 
         // Create render list entries for all primitives
@@ -934,22 +939,169 @@ void scene_stage::add_instances(
             render_entry entry = {id, r.mask, group_index++, i++, 0.0f};
             generic_render_list.push_back(entry);
 
+            // Uncullable entries get an infinite box. The SIMD culling test
+            // can't produce NaNs from it, because it only sums the largest
+            // products along each axis.
             aabb bounding_box;
-            bool cullable = opt.frustum_culling && group.get_primitive()->get_bounding_box(bounding_box);
-            for(size_t j = 0; j < camera_render_list.size(); ++j)
-            {
-                if(!cullable || aabb_frustum_cull(
-                    bounding_box,
-                    camera_local_frusta[j]
-                )){
-                    entry.depth = camera_local_depths[j];
-                    camera_render_list[j].push_back(entry);
-                }
-            }
+            if(opt.frustum_culling && group.get_primitive()->get_bounding_box(bounding_box))
+                bounding_box = aabb_from_obb(bounding_box, model_mat);
+            else bounding_box = {vec3(-FLT_MAX), vec3(FLT_MAX)};
+            render_entry_bounds.push_back(bounding_box);
+            // All primitives in the model share the same depth.
+            render_entry_origins.push_back(pos);
         }
     });
 }
 
+void scene_stage::build_camera_render_lists(argvec<frustum> camera_frusta)
+{
+    if(opt.camera_group_size != 0)
+    {
+        size_t group_size = opt.camera_group_size;
+        size_t group_count = (camera_frusta.size() + group_size - 1) / group_size;
+        auto tasks = stack_allocate<std::function<void()>>(group_count);
+        for(size_t g = 0; g < group_count; ++g)
+        {
+            argvec<frustum> group_frusta(
+                camera_frusta.data() + g * group_size,
+                std::min(group_size, camera_frusta.size() - g * group_size)
+            );
+            tasks[g] = [this, g, group_frusta](){
+                build_camera_group_render_list(g, group_frusta);
+            };
+        }
+        if(group_count == 1) tasks[0]();
+        else dev->ctx->get_thread_pool().add_tasks(tasks).wait();
+        return;
+    }
+
+    if(camera_frusta.size() <= 1)
+    {
+        for(size_t j = 0; j < camera_frusta.size(); ++j)
+            build_camera_render_list(j, camera_frusta[j]);
+        return;
+    }
+
+    // Each camera only writes to its own render list, so they can all be
+    // culled and sorted in parallel.
+    auto tasks = stack_allocate<std::function<void()>>(camera_frusta.size());
+    for(size_t j = 0; j < camera_frusta.size(); ++j)
+    {
+        tasks[j] = [this, j, f = camera_frusta[j]](){
+            build_camera_render_list(j, f);
+        };
+    }
+    dev->ctx->get_thread_pool().add_tasks(tasks).wait();
+}
+
+void scene_stage::build_camera_render_list(size_t camera_index, const frustum& f)
+{
+    std::vector<render_entry>& list = camera_render_list[camera_index];
+    size_t count = generic_render_list.size();
+
+    auto visible = stack_allocate<bool>(count);
+    if(opt.frustum_culling)
+        aabb_frustum_cull_batch(render_entry_bounds.data(), count, f, visible.get());
+    else std::fill(visible.begin(), visible.end(), true);
+
+    list.clear();
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(!visible[i])
+            continue;
+
+        render_entry entry = generic_render_list[i];
+        // Approx depth for depth sorting.
+        if(opt.depth_sort)
+            entry.depth = dot(f.planes[5], vec4(render_entry_origins[i], 1.0f));
+        list.push_back(entry);
+    }
+
+    if(opt.depth_sort)
+    {
+        auto keys = stack_allocate<float>(list.size());
+        for(size_t i = 0; i < list.size(); ++i)
+            keys[i] = list[i].depth;
+        radix_sort(list.size(), keys.get(), list.data());
+    }
+}
+
+void scene_stage::build_camera_group_render_list(
+    size_t group_index,
+    argvec<frustum> camera_frusta
+){
+    std::vector<render_entry>& list = camera_group_render_list[group_index];
+    std::vector<uint32_t>& visibility = camera_group_visibility[group_index];
+    size_t count = generic_render_list.size();
+    frustum group_frustum = bounding_frustum(camera_frusta.data(), camera_frusta.size());
+
+    // Cull against the whole group first, so that the individual cameras only
+    // need to look at the survivors.
+    auto visible = stack_allocate<bool>(count);
+    if(opt.frustum_culling)
+        aabb_frustum_cull_batch(render_entry_bounds.data(), count, group_frustum, visible.get());
+    else std::fill(visible.begin(), visible.end(), true);
+
+    auto survivors = stack_allocate<uint32_t>(count);
+    auto survivor_bounds = stack_allocate<aabb>(count);
+    size_t survivor_count = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(!visible[i])
+            continue;
+        survivors[survivor_count] = i;
+        survivor_bounds[survivor_count] = render_entry_bounds[i];
+        survivor_count++;
+    }
+
+    auto masks = stack_allocate<uint32_t>(survivor_count);
+    if(opt.frustum_culling)
+    {
+        std::fill(masks.begin(), masks.end(), 0);
+        for(size_t j = 0; j < camera_frusta.size(); ++j)
+        {
+            aabb_frustum_cull_batch(
+                survivor_bounds.get(), survivor_count, camera_frusta[j],
+                visible.get()
+            );
+            for(size_t i = 0; i < survivor_count; ++i)
+                masks[i] |= uint32_t(visible[i]) << j;
+        }
+    }
+    else
+    {
+        uint32_t all_cameras = 0xFFFFFFFFu >> (32 - camera_frusta.size());
+        std::fill(masks.begin(), masks.end(), all_cameras);
+    }
+
+    auto order = stack_allocate<uint32_t>(survivor_count);
+    auto keys = stack_allocate<float>(survivor_count);
+    size_t visible_count = 0;
+    for(size_t i = 0; i < survivor_count; ++i)
+    {
+        if(masks[i] == 0)
+            continue;
+        order[visible_count] = i;
+        // Approx depth for depth sorting, from the near plane of the group.
+        keys[visible_count] = opt.depth_sort ?
+            dot(group_frustum.planes[5], vec4(render_entry_origins[survivors[i]], 1.0f)) :
+            0.0f;
+        visible_count++;
+    }
+    if(opt.depth_sort)
+        radix_sort(visible_count, keys.get(), order.get());
+
+    list.clear();
+    visibility.clear();
+    for(size_t i = 0; i < visible_count; ++i)
+    {
+        render_entry entry = generic_render_list[survivors[order[i]]];
+        entry.depth = keys[i];
+        list.push_back(entry);
+        visibility.push_back(masks[order[i]]);
+    }
+}
+
 bool scene_stage::update_object_buffers(uint32_t frame_index)
 {
     bool need_descriptor_set_update = false;
@@ -1011,7 +1163,14 @@ bool scene_stage::update_object_buffers(uint32_t frame_index)
 
     RB_CHECK(camera_count == 0, "No camera in scene!");
     auto camera_frusta = global_stack_allocator.allocate<frustum>(camera_count);
-    camera_render_list.resize(camera_count);
+    if(opt.camera_group_size != 0)
+    {
+        size_t group_count = (camera_count + opt.camera_group_size - 1) / opt.camera_group_size;
+        camera_group_render_list.resize(group_count);
+        camera_group_visibility.resize(group_count);
+        camera_render_list.clear();
+    }
+    else camera_render_list.resize(camera_count);
     need_descriptor_set_update |= cameras.resize(camera_count * sizeof(gpu_camera));
     cameras.update<gpu_camera>(frame_index, [&](gpu_camera* data) {
         for(size_t i = 0; i < camera_indices.size(); ++i)
@@ -1069,9 +1228,10 @@ bool scene_stage::update_object_buffers(uint32_t frame_index)
         size_t i = 0;
         // Static and dynamic instances should be segmented separately so that
         // merged static acceleration structures are easier to do.
-        add_instances(data, i, camera_frusta, true);
-        add_instances(data, i, camera_frusta, false);
+        add_instances(data, i, true);
+        add_instances(data, i, false);
     });
+    build_camera_render_lists(camera_frusta);
 
     need_descriptor_set_update |= morph_target_weights.resize(morph_target_weight_count * sizeof(float));
     morph_target_weights.update<float>(frame_index, [&](float* data){
@@ -1094,50 +1254,95 @@ bool scene_stage::update_object_buffers(uint32_t frame_index)
         dualquat_joint_count * sizeof(dualquat)
     );
     skeletal_joints.update<float>(frame_index, [&](float* data){
-        float* mat_ptr = data;
-        float* dquat_ptr = data + matrix_joint_count * sizeof(mat4) / sizeof(float);
-        for(mesh* m: animated_mesh_indices)
+        write_skeletal_joints(data);
+    });
+
+    return need_descriptor_set_update;
+}
+
+void scene_stage::write_skeletal_joints(float* data)
+{
+    // Output ranges are assigned serially, in the same order as the joint
+    // counts were gathered.
+    struct joint_target
+    {
+        skeleton* skel;
+        float* dst;
+        size_t bytes;
+    };
+    std::vector<joint_target> targets;
+    targets.reserve(animated_mesh_indices.size());
+
+    float* mat_ptr = data;
+    float* dquat_ptr = data + matrix_joint_count * sizeof(mat4) / sizeof(float);
+    for(mesh* m: animated_mesh_indices)
+    {
+        if(skeleton* skel = m->get_skeleton())
         {
-            if(skeleton* skel = m->get_skeleton())
+            skeleton::skinning_mode skin = skel->get_skinning_mode();
+            if(skin == skeleton::LINEAR)
             {
-                skeleton::skinning_mode skin = skel->get_skinning_mode();
-                // TODO: Figure out how to avoid referring to some root
-                // transformable in the joint transform refresh
-                void* joint_data = skel->refresh_joint_transforms();
-                if(skin == skeleton::LINEAR)
-                {
-                    size_t data_size = skel->get_true_joint_count() * sizeof(mat4);
-                    memcpy(mat_ptr, joint_data, data_size);
-                    mat_ptr += data_size / sizeof(float);
-                }
-                else if(skin == skeleton::DUAL_QUATERNION)
-                {
-                    size_t data_size = skel->get_true_joint_count() * sizeof(dualquat);
-                    memcpy(dquat_ptr, joint_data, data_size);
-                    dquat_ptr += data_size / sizeof(float);
-                }
+                size_t data_size = skel->get_true_joint_count() * sizeof(mat4);
+                targets.push_back({skel, mat_ptr, data_size});
+                mat_ptr += data_size / sizeof(float);
+            }
+            else if(skin == skeleton::DUAL_QUATERNION)
+            {
+                size_t data_size = skel->get_true_joint_count() * sizeof(dualquat);
+                targets.push_back({skel, dquat_ptr, data_size});
+                dquat_ptr += data_size / sizeof(float);
             }
         }
-    });
+    }
 
-    // Sort render lists if requested
-    if(opt.depth_sort)
+    // Meshes can share a skeleton, so group them such that each skeleton is
+    // refreshed by only one task.
+    std::stable_sort(
+        targets.begin(), targets.end(),
+        [](const joint_target& a, const joint_target& b){ return a.skel < b.skel; }
+    );
+    std::vector<size_t> group_begin;
+    for(size_t i = 0; i < targets.size(); ++i)
     {
-        for(size_t j = 0; j < camera_render_list.size(); ++j)
+        if(i == 0 || targets[i].skel != targets[i-1].skel)
         {
-            // TODO: Radix sort
-            std::sort(
-                camera_render_list[j].begin(),
-                camera_render_list[j].end(),
-                [](const render_entry& a, const render_entry& b)
-                {
-                    return a.depth < b.depth;
-                }
-            );
+            group_begin.push_back(i);
+            // TODO: Figure out how to avoid referring to some root
+            // transformable in the joint transform refresh
+            targets[i].skel->update_root_parent_transforms();
         }
     }
+    group_begin.push_back(targets.size());
 
-    return need_descriptor_set_update;
+    auto refresh_groups = [&](size_t begin, size_t end){
+        for(size_t g = begin; g < end; ++g)
+        {
+            void* joint_data = targets[group_begin[g]].skel->refresh_joint_transforms();
+            for(size_t i = group_begin[g]; i < group_begin[g+1]; ++i)
+                memcpy(targets[i].dst, joint_data, targets[i].bytes);
+        }
+    };
+
+    constexpr size_t skeletons_per_task = 16;
+    size_t group_count = group_begin.size() - 1;
+    size_t task_count = (group_count + skeletons_per_task - 1) / skeletons_per_task;
+    if(task_count <= 1)
+    {
+        refresh_groups(0, group_count);
+        return;
+    }
+
+    auto tasks = stack_allocate<std::function<void()>>(task_count);
+    for(size_t t = 0; t < task_count; ++t)
+    {
+        tasks[t] = [&, t](){
+            refresh_groups(
+                t * skeletons_per_task,
+                std::min((t+1) * skeletons_per_task, group_count)
+            );
+        };
+    }
+    dev->ctx->get_thread_pool().add_tasks(tasks).wait();
 }
 
 bool scene_stage::update_light_buffers(uint32_t frame_index)
@@ -1177,6 +1382,7 @@ bool scene_stage::update_light_buffers(uint32_t frame_index)
     light_bounds[1] = vec3(-FLT_MAX);
 
     unsorted_point_light_prev_map.resize(point_light_count);
+    point_light_positions.resize(point_light_count);
     unsorted_point_lights.update<gpu_point_light>(frame_index, [&](gpu_point_light* data){
         size_t i = 0;
         current_scene->foreach([&](
@@ -1197,6 +1403,7 @@ bool scene_stage::update_light_buffers(uint32_t frame_index)
             };
             light_bounds[0] = min(light_bounds[0], pos - cutoff);
             light_bounds[1] = max(light_bounds[1], pos + cutoff);
+            point_light_positions[i] = pos;
 
             size_t update_hash = 1;
             hash_combine(update_hash, t.update_cached_transform());
@@ -1238,6 +1445,7 @@ bool scene_stage::update_light_buffers(uint32_t frame_index)
             float cutoff = l.get_cutoff_radius();
             int shadow_map_index16 = 0xFFFF;
             float spot_radius = l.cutoff_angle <= 89 ?  cutoff * tan(glm::radians(l.cutoff_angle)) : -1;
+            point_light_positions[i] = pos;
             data[i++] = {
                 pos.x, pos.y, pos.z, rgb_to_rgbe(l.color),
                 packHalf2x16(vec2(l.radius, cutoff)),
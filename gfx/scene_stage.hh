@@ -104,6 +104,16 @@ public:
         // from being GPU-bound, you may just want to disable this.
         bool frustum_culling = true;
 
+        // If nonzero, active cameras are culled in consecutive groups of this
+        // many cameras (at most 32). Entries are first culled against a
+        // frustum bounding the whole group, and only the survivors are tested
+        // against each camera of the group. Instead of a render list per
+        // camera, each group then gets a single render list with a camera
+        // visibility bitmask per entry. Useful for multiview rigs, where the
+        // cameras only differ by small translations. Match this with
+        // multiview_forward_stage::options::max_view_group_size.
+        uint32_t camera_group_size = 0;
+
         // Can increase performance by reducing overdraw: coarsely sorts
         // render lists such that objects nearest to the camera are rendered
         // first.
@@ -168,6 +178,18 @@ public:
     ) const;
     const std::vector<entity>& get_active_cameras() const;
 
+    // Only available if options::camera_group_size is nonzero, in which case
+    // get_render_list() returns the render list of the camera's group. Bit i
+    // of a visibility mask is set if camera (group * camera_group_size + i)
+    // sees the corresponding render list entry.
+    uint32_t get_camera_group_size() const;
+    const std::vector<render_entry>& get_camera_group_render_list(
+        uint32_t group_index
+    ) const;
+    const std::vector<uint32_t>& get_camera_group_visibility(
+        uint32_t group_index
+    ) const;
+
     VkAccelerationStructureKHR get_tlas_handle() const;
     bool has_temporal_tlas() const;
 
@@ -182,11 +204,17 @@ private:
     void add_instances(
         void* data,
         size_t& index,
-        argvec<frustum> camera_frusta,
         bool static_instances
     );
+    void build_camera_render_lists(argvec<frustum> camera_frusta);
+    void build_camera_render_list(size_t camera_index, const frustum& f);
+    void build_camera_group_render_list(
+        size_t group_index,
+        argvec<frustum> camera_frusta
+    );
 
     bool update_object_buffers(uint32_t frame_index);
+    void write_skeletal_joints(float* data);
     bool update_light_buffers(uint32_t frame_index);
     bool update_decal_buffers(uint32_t frame_index);
     bool update_envmap_buffers(uint32_t frame_index);
@@ -243,6 +271,8 @@ private:
     gpu_buffer temporal_tables;
 
     vec3 light_bounds[2];
+    // CPU-side copy of unsorted point light positions, for clustering.
+    std::vector<vec3> point_light_positions;
     vec3 decal_bounds[2];
 
     unique_index_table<const primitive*> primitive_indices;
@@ -263,8 +293,15 @@ private:
     // This always contains all instances, in order.
     // (i.e. generic_render_list[i].instance_index == i)
     std::vector<render_entry> generic_render_list;
+    // World-space bounding boxes and origins of the entries in
+    // generic_render_list, used for culling and depth sorting.
+    std::vector<aabb> render_entry_bounds;
+    std::vector<vec3> render_entry_origins;
     // These are culled by camera frustum.
     std::vector<std::vector<render_entry>> camera_render_list;
+    // These are used instead of camera_render_list when cameras are grouped.
+    std::vector<std::vector<render_entry>> camera_group_render_list;
+    std::vector<std::vector<uint32_t>> camera_group_visibility;
 
     // pos, normal and tangent always reside in the same buffer. The rest can
     // be from another set of buffers. They all have different offsets, though.
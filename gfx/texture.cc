@@ -4,6 +4,200 @@
 #include "core/io.hh"
 #include "core/string.hh"
 #include "core/error.hh"
+#include <type_traits>
+
+namespace
+{
+using namespace rb;
+using namespace rb::gfx;
+
+constexpr char cooked_texture_magic[4] = {'R', 'B', 'T', 'X'};
+constexpr uint32_t cooked_texture_version = 2;
+
+enum cooked_texture_flags: uint32_t
+{
+    COOKED_TEXTURE_OPAQUE = 1<<0,
+    COOKED_TEXTURE_FLIPPED = 1<<1
+};
+
+// Followed by data_size bytes of texel data, with all mip levels in the order
+// create_gpu_image() expects them.
+struct cooked_texture_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t dim[3];
+    uint32_t flags;
+    uint32_t padding;
+    uint64_t source_size;
+    // Zero if the source filesystem doesn't track modification times.
+    uint64_t source_mtime;
+    uint64_t source_hash;
+    uint64_t data_size;
+};
+
+uint64_t get_modification_time(const file& f)
+{
+    filesystem* source = f.get_source_filesystem();
+    return source ? source->get_modification_time(f.get_name()) : 0;
+}
+
+void* decode_stb_image(
+    const file& f, bool flip, texture::options& opt, size_t& data_size
+){
+    bool hdr = stbi_is_hdr_from_memory(f.get_data(), f.get_size());
+    void* data = nullptr;
+    int channels = 0;
+    opt.dim.z = 1;
+    // The global flip setting would race with decodes on other threads.
+    stbi_set_flip_vertically_on_load_thread(flip);
+    if(hdr)
+    {
+        data = stbi_loadf_from_memory(
+            f.get_data(), f.get_size(), (int*)&opt.dim.x, (int*)&opt.dim.y, &channels, 0
+        );
+        data_size = opt.dim.x * opt.dim.y * channels * sizeof(float);
+    }
+    else
+    {
+        data = stbi_load_from_memory(
+            f.get_data(), f.get_size(), (int*)&opt.dim.x, (int*)&opt.dim.y, &channels, 0
+        );
+        data_size = opt.dim.x * opt.dim.y * channels * sizeof(uint8_t);
+    }
+    RB_CHECK(!data, "Failed to load image ", f.get_name());
+    opt.opaque = channels < 4;
+
+    // Vulkan implementations don't really support 3-channel textures...
+    if(channels == 3)
+    {
+        if(hdr)
+        {
+            size_t new_data_size = opt.dim.x * opt.dim.y * 4 * sizeof(float);
+            float* new_data = (float*)malloc(new_data_size);
+            float fill = 1.0;
+            interlace(new_data, data, &fill, 3 * sizeof(float), 4 * sizeof(float), opt.dim.x*opt.dim.y);
+            free(data);
+            data = new_data;
+            data_size = new_data_size;
+        }
+        else
+        {
+            size_t new_data_size = opt.dim.x * opt.dim.y * 4 * sizeof(uint8_t);
+            uint8_t* new_data = (uint8_t*)malloc(new_data_size);
+            uint8_t fill = 255;
+            interlace(new_data, data, &fill, 3 * sizeof(uint8_t), 4 * sizeof(uint8_t), opt.dim.x*opt.dim.y);
+            free(data);
+            data = new_data;
+            data_size = new_data_size;
+        }
+        channels = 4;
+    }
+
+    switch(channels)
+    {
+    default:
+    case 1:
+        opt.format = hdr ? VK_FORMAT_R32_SFLOAT : VK_FORMAT_R8_UNORM;
+        break;
+    case 2:
+        opt.format = hdr ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R8G8_UNORM;
+        break;
+    case 3:
+        opt.format = hdr ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R8G8B8_UNORM;
+        break;
+    case 4:
+        opt.format = hdr ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+        break;
+    }
+
+    opt.tiling = VK_IMAGE_TILING_OPTIMAL;
+    opt.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    if(opt.layout == VK_IMAGE_LAYOUT_GENERAL)
+        opt.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    opt.samples = VK_SAMPLE_COUNT_1_BIT;
+    opt.type = VK_IMAGE_VIEW_TYPE_2D;
+    opt.array_layers = 1;
+
+    return data;
+}
+
+template<typename T>
+void downsample_2d(
+    const T* src, uvec2 src_dim, T* dst, uvec2 dst_dim, unsigned channels
+){
+    for(unsigned y = 0; y < dst_dim.y; ++y)
+    for(unsigned x = 0; x < dst_dim.x; ++x)
+    {
+        unsigned x0 = min(x*2, src_dim.x-1);
+        unsigned x1 = min(x*2+1, src_dim.x-1);
+        unsigned y0 = min(y*2, src_dim.y-1);
+        unsigned y1 = min(y*2+1, src_dim.y-1);
+        for(unsigned c = 0; c < channels; ++c)
+        {
+            float sum =
+                float(src[(y0 * src_dim.x + x0) * channels + c]) +
+                float(src[(y0 * src_dim.x + x1) * channels + c]) +
+                float(src[(y1 * src_dim.x + x0) * channels + c]) +
+                float(src[(y1 * src_dim.x + x1) * channels + c]);
+            if constexpr(std::is_integral_v<T>)
+                dst[(y * dst_dim.x + x) * channels + c] = T(sum * 0.25f + 0.5f);
+            else
+                dst[(y * dst_dim.x + x) * channels + c] = T(sum * 0.25f);
+        }
+    }
+}
+
+// Box-filters the rest of the mip chain after the level at 'offset'. Formats
+// that can't be filtered on the CPU are left with just the first level, and
+// they get their mipmaps generated on the GPU instead.
+void append_mipmaps(
+    std::vector<uint8_t>& data, size_t offset, uvec3 dim, VkFormat format
+){
+    size_t component_size = 0;
+    switch(format)
+    {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        component_size = sizeof(uint8_t);
+        break;
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        component_size = sizeof(float);
+        break;
+    default:
+        return;
+    }
+    if(dim.z != 1) return;
+
+    size_t pixel_size = get_format_size(format);
+    unsigned channels = pixel_size / component_size;
+    unsigned levels = calculate_mipmap_count(uvec2(dim));
+    uvec2 src_dim = dim;
+    for(unsigned level = 1; level < levels; ++level)
+    {
+        uvec2 dst_dim = max(src_dim / 2u, uvec2(1));
+        size_t src_size = src_dim.x * src_dim.y * pixel_size;
+        data.resize(data.size() + dst_dim.x * dst_dim.y * pixel_size);
+        if(component_size == sizeof(uint8_t))
+            downsample_2d(
+                data.data() + offset, src_dim,
+                data.data() + offset + src_size, dst_dim, channels
+            );
+        else
+            downsample_2d(
+                (const float*)(data.data() + offset), src_dim,
+                (float*)(data.data() + offset + src_size), dst_dim, channels
+            );
+        offset += src_size;
+        src_dim = dst_dim;
+    }
+}
+
+}
 
 namespace rb::gfx
 {
@@ -258,78 +452,66 @@ void texture::save(const std::string& path, bool flip)
 
 void texture::load_from_file(super_impl_data& d, const file& f, bool mipmapped, bool flip)
 {
-    fs::path fp(f.get_name());
+    // Cooked versions of image files are used automatically when they're
+    // next to the original file.
+    filesystem* source = f.get_source_filesystem();
+    std::string cooked_name = f.get_name() + ".rbtex";
+    if(
+        source && source->exists(cooked_name) &&
+        load_from_cooked(d, f, source->get(cooked_name), mipmapped, flip)
+    ) return;
+
     load_from_stb(d, f, mipmapped, flip);
 }
 
 void texture::load_from_stb(super_impl_data& d, const file& f, bool mipmapped, bool flip)
 {
-    bool hdr = stbi_is_hdr_from_memory(f.get_data(), f.get_size());
-    void* data = nullptr;
     size_t data_size = 0;
-    int channels = 0;
-    d.opt.dim.z = 1;
-    stbi_set_flip_vertically_on_load(flip);
-    if(hdr)
-    {
-        data = stbi_loadf_from_memory(
-            f.get_data(), f.get_size(), (int*)&d.opt.dim.x, (int*)&d.opt.dim.y, &channels, 0
-        );
-        data_size = d.opt.dim.x * d.opt.dim.y * channels * sizeof(float);
-    }
-    else
-    {
-        data = stbi_load_from_memory(
-            f.get_data(), f.get_size(), (int*)&d.opt.dim.x, (int*)&d.opt.dim.y, &channels, 0
-        );
-        data_size = d.opt.dim.x * d.opt.dim.y * channels * sizeof(uint8_t);
-    }
-    RB_CHECK(!data, "Failed to load image ", f.get_name());
-    d.opt.opaque = channels < 4;
+    void* data = decode_stb_image(f, flip, d.opt, data_size);
 
-    // Vulkan implementations don't really support 3-channel textures...
-    if(channels == 3)
-    {
-        if(hdr)
-        {
-            size_t new_data_size = d.opt.dim.x * d.opt.dim.y * 4 * sizeof(float);
-            float* new_data = (float*)malloc(new_data_size);
-            float fill = 1.0;
-            interlace(new_data, data, &fill, 3 * sizeof(float), 4 * sizeof(float), d.opt.dim.x*d.opt.dim.y);
-            free(data);
-            data = new_data;
-            data_size = new_data_size;
-        }
-        else
-        {
-            size_t new_data_size = d.opt.dim.x * d.opt.dim.y * 4 * sizeof(uint8_t);
-            uint8_t* new_data = (uint8_t*)malloc(new_data_size);
-            uint8_t fill = 255;
-            interlace(new_data, data, &fill, 3 * sizeof(uint8_t), 4 * sizeof(uint8_t), d.opt.dim.x*d.opt.dim.y);
-            free(data);
-            data = new_data;
-            data_size = new_data_size;
-        }
-        channels = 4;
-    }
+    d.image = create_gpu_image(
+        *d.dev, d.loading_events.emplace_back(), d.opt.dim, 1, d.opt.format,
+        d.opt.layout, d.opt.samples, d.opt.tiling, d.opt.usage, VK_IMAGE_VIEW_TYPE_2D,
+        data_size, data, mipmapped
+    );
 
-    switch(channels)
-    {
-    default:
-    case 1:
-        d.opt.format = hdr ? VK_FORMAT_R32_SFLOAT : VK_FORMAT_R8_UNORM;
-        break;
-    case 2:
-        d.opt.format = hdr ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R8G8_UNORM;
-        break;
-    case 3:
-        d.opt.format = hdr ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R8G8B8_UNORM;
-        break;
-    case 4:
-        d.opt.format = hdr ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
-        break;
-    }
+    save_pixel_data(d, data_size, data);
+    stbi_image_free(data);
+    d.view = create_image_view(*d.dev, d.image, d.opt.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    RB_GC_LABEL(d.dev->gc, *d.image, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , f.get_name(), ")");
+    RB_GC_LABEL(d.dev->gc, *d.view, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , f.get_name(), "), view");
+}
 
+bool texture::load_from_cooked(
+    super_impl_data& d,
+    const file& source,
+    const file& cooked,
+    bool mipmapped,
+    bool flip
+){
+    const cooked_texture_header* header =
+        (const cooked_texture_header*)cooked.get_data();
+    if(
+        cooked.get_size() < sizeof(cooked_texture_header) ||
+        memcmp(header->magic, cooked_texture_magic, sizeof(header->magic)) != 0 ||
+        header->version != cooked_texture_version ||
+        header->data_size > cooked.get_size() - sizeof(cooked_texture_header) ||
+        bool(header->flags & COOKED_TEXTURE_FLIPPED) != flip ||
+        header->source_size != source.get_size()
+    ) return false;
+
+    // Hashing large images costs about as much as decoding them, so the hash
+    // is only checked when the modification time doesn't prove a match.
+    uint64_t mtime = get_modification_time(source);
+    if(
+        (mtime == 0 || mtime != header->source_mtime) &&
+        header->source_hash != hash_data(source.get_data(), source.get_size())
+    ) return false;
+
+    const uint8_t* data = cooked.get_data() + sizeof(cooked_texture_header);
+    d.opt.dim = uvec3(header->dim[0], header->dim[1], header->dim[2]);
+    d.opt.format = (VkFormat)header->format;
+    d.opt.opaque = header->flags & COOKED_TEXTURE_OPAQUE;
     d.opt.tiling = VK_IMAGE_TILING_OPTIMAL;
     d.opt.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
     if(d.opt.layout == VK_IMAGE_LAYOUT_GENERAL)
@@ -338,17 +520,56 @@ void texture::load_from_stb(super_impl_data& d, const file& f, bool mipmapped, b
     d.opt.type = VK_IMAGE_VIEW_TYPE_2D;
     d.opt.array_layers = 1;
 
+    // If all mip levels are included, create_gpu_image() uploads them as-is
+    // instead of generating them.
     d.image = create_gpu_image(
         *d.dev, d.loading_events.emplace_back(), d.opt.dim, 1, d.opt.format,
         d.opt.layout, d.opt.samples, d.opt.tiling, d.opt.usage, VK_IMAGE_VIEW_TYPE_2D,
-        data_size, data, mipmapped
+        header->data_size, (void*)data, mipmapped
     );
 
-    save_pixel_data(d, data_size, data);
-    stbi_image_free(data);
+    uvec3 dim = d.opt.dim;
+    save_pixel_data(d, dim.x * dim.y * dim.z * get_format_size(d.opt.format), data);
     d.view = create_image_view(*d.dev, d.image, d.opt.format, VK_IMAGE_ASPECT_COLOR_BIT);
-    RB_GC_LABEL(d.dev->gc, *d.image, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , f.get_name(), ")");
-    RB_GC_LABEL(d.dev->gc, *d.view, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , f.get_name(), "), view");
+    RB_GC_LABEL(d.dev->gc, *d.image, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , cooked.get_name(), ")");
+    RB_GC_LABEL(d.dev->gc, *d.view, d.opt.dim, " ", d.opt.format, " ", d.opt.type, " (loaded from " , cooked.get_name(), "), view");
+    return true;
+}
+
+void texture::cook(
+    const file& f,
+    const std::string& path,
+    bool mipmapped,
+    bool flip
+){
+    options opt;
+    size_t data_size = 0;
+    void* data = decode_stb_image(f, flip, opt, data_size);
+
+    cooked_texture_header header;
+    memcpy(header.magic, cooked_texture_magic, sizeof(header.magic));
+    header.version = cooked_texture_version;
+    header.format = opt.format;
+    header.dim[0] = opt.dim.x;
+    header.dim[1] = opt.dim.y;
+    header.dim[2] = opt.dim.z;
+    header.flags = (opt.opaque ? COOKED_TEXTURE_OPAQUE : 0) |
+        (flip ? COOKED_TEXTURE_FLIPPED : 0);
+    header.padding = 0;
+    header.source_size = f.get_size();
+    header.source_mtime = get_modification_time(f);
+    header.source_hash = hash_data(f.get_data(), f.get_size());
+
+    std::vector<uint8_t> out(sizeof(header));
+    out.insert(out.end(), (uint8_t*)data, (uint8_t*)data + data_size);
+    stbi_image_free(data);
+
+    if(mipmapped)
+        append_mipmaps(out, sizeof(header), opt.dim, opt.format);
+
+    header.data_size = out.size() - sizeof(header);
+    memcpy(out.data(), &header, sizeof(header));
+    write_binary_file(path, out.data(), out.size());
 }
 
 void texture::load_from_data(super_impl_data& d)
@@ -121,6 +121,18 @@ public:
     // determined from the path. Flipping only works on non-KTX formats.
     void save(const std::string& path, bool flip = false);
 
+    // Decodes an image file and writes it into 'path' in a cooked format that
+    // loads without decoding. All mipmaps are precomputed, except for formats
+    // that can't be filtered on the CPU. When loading an image file, a cooked
+    // file named like the image plus ".rbtex" is used instead if it exists and
+    // matches the image and flip setting.
+    static void cook(
+        const file& f,
+        const std::string& path,
+        bool mipmapped = true,
+        bool flip = true
+    );
+
     struct impl_data
     {
         mutable std::vector<uint8_t> pixel_data;
@@ -135,6 +147,13 @@ private:
     using super_impl_data = async_loadable_resource<texture>::impl_data;
     static void load_from_file(super_impl_data& d, const file& f, bool mipmapped, bool flip);
     static void load_from_stb(super_impl_data& d, const file& f, bool mipmapped, bool flip);
+    static bool load_from_cooked(
+        super_impl_data& d,
+        const file& source,
+        const file& cooked,
+        bool mipmapped,
+        bool flip
+    );
     static void load_from_data(super_impl_data& d);
     static void save_pixel_data(impl_data& d, size_t data_size, const void* data);
     static void save_stb(super_impl_data& d, const std::string& path, bool flip);
@@ -1013,6 +1013,7 @@ template std::vector<puvec4> read_formatted_data(size_t, const void*, VkFormat);
 SDL_Surface* load_image(const char* path)
 {
     int w, h, dummy;
+    stbi_set_flip_vertically_on_load_thread(false);
     uint8_t* data = stbi_load(path, &w, &h, &dummy, STBI_rgb_alpha);
     if(!data) RB_PANIC("Failed to read icon from ", path);
 
@@ -7,20 +7,31 @@
 #define RAYBASE_SCENE_SET 0
 #include "scene.glsl"
 
-layout(location = 0) in vec3 in_pos;
+// Set when drawing primitives with packed attributes.
+layout(constant_id = 13) const uint RB_PACKED_VERTICES = 0;
+
+layout(location = 0) in vec4 in_pos;
 
 layout(push_constant) uniform push_constant_buffer
 {
     uint instance_index;
     uint camera_index;
+    layout(offset = 48) vec4 position_offset;
+    vec4 position_scale;
 } pc;
 
 void main()
 {
-    const instance inst = instances.array[pc.instance_index];
+    // Indirect draws pass the instance index in firstInstance instead.
+    uint instance_index = pc.instance_index + uint(gl_InstanceIndex);
+    const instance inst = instances.array[instance_index];
     const camera cam = cameras.array[pc.camera_index];
 
-    vec3 pos = (inst.model_to_world * vec4(in_pos, 1)).xyz;
+    vec3 pos = in_pos.xyz;
+    if(RB_PACKED_VERTICES != 0)
+        pos = pc.position_offset.xyz + pos * pc.position_scale.xyz;
+
+    pos = (inst.model_to_world * vec4(pos, 1)).xyz;
     gl_Position = cam.view_proj * vec4(pos, 1);
 }
 
@@ -12,6 +12,7 @@
 #define MULTIVIEW_SIZE rb::ivec2(256, 256)
 #define AVG_OVER_FRAMES 100
 #define SKIP_FRAMES 20
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
 
 namespace rg = rb::gfx;
 namespace rp = rb::phys;
@@ -401,6 +402,7 @@ int main()
     rg::window win(gfx_ctx, "Implicit grid benchmark", rb::ivec2(1920, 1080), false);
     win.set_mouse_grab(false);
     win.set_vsync(false);
+    win.get_device().load_pipeline_cache(PIPELINE_CACHE_PATH);
 
     rb::native_filesystem fs("data");
     rb::resource_store store("", {&fs});
@@ -533,5 +535,6 @@ int main()
         cur_ren->render();
     }
 
+    win.get_device().save_pipeline_cache(PIPELINE_CACHE_PATH);
     return 0;
 }
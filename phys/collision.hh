@@ -2,6 +2,7 @@
 #define RAYBASE_PHYS_COLLISION_HH
 #include "core/ecs.hh"
 #include "core/math.hh"
+#include <vector>
 
 namespace rb::phys
 {
@@ -14,6 +15,25 @@ struct collision
     vec3 local_pos[2];
 };
 
+// All contact points between one pair of colliders in a collision_batch.
+struct collision_pair
+{
+    entity id[2];
+    unsigned subindex[2];
+    uint32_t first_contact;
+    uint32_t contact_count;
+};
+
+// Emitted once per step with every contact point of that step, as an
+// alternative to handling the individual 'collision' events. Contacts of the
+// same pair are consecutive, and 'pairs' lists them per pair. The vectors are
+// only valid during the event handler.
+struct collision_batch
+{
+    const std::vector<collision>* contacts;
+    const std::vector<collision_pair>* pairs;
+};
+
 struct intersection
 {
     vec3 pos;
@@ -8,7 +8,7 @@ namespace rb::phys
 {
 
 collision_system::collision_system(context& ctx, scene& s, options opt)
-: s(&s)
+: pool(&ctx.get_thread_pool()), s(&s)
 {
     collision_configuration.reset(new btDefaultCollisionConfiguration());
     pair_cache.reset(new btDbvtBroadphase());
@@ -38,23 +38,7 @@ void collision_system::run()
     refresh_all();
     world->performDiscreteCollisionDetection();
 
-    int num = dispatcher->getNumManifolds();
-    for(int i = 0; i < num; ++i)
-    {
-        btPersistentManifold* man = dispatcher->getManifoldByIndexInternal(i);
-        const btCollisionObject* o0 = man->getBody0();
-        const btCollisionObject* o1 = man->getBody1();
-        for(int j = 0; j < man->getNumContacts(); ++j)
-        {
-            const btManifoldPoint& point = man->getContactPoint(j);
-            s->emit(collision{
-                {(entity)o0->getUserIndex(), (entity)o1->getUserIndex()},
-                {(unsigned)o0->getUserIndex2(), (unsigned)o1->getUserIndex2()},
-                {bt_to_glm(point.getPositionWorldOnA()), bt_to_glm(point.getPositionWorldOnB())},
-                {bt_to_glm(point.m_localPointA), bt_to_glm(point.m_localPointB)}
-            });
-        }
-    }
+    emit_collisions(*s, dispatcher.get(), step_contacts, step_pairs);
 }
 
 void collision_system::set_debug_drawer(btIDebugDraw* drawer)
@@ -72,18 +56,15 @@ std::optional<intersection> collision_system::cast_ray_closest_hit(
     float max_distance
 ) const
 {
-    btVector3 from = glm_to_bt(r.o);
-    btVector3 to = glm_to_bt(r.o+normalize(r.dir)*max_distance);
-    btCollisionWorld::ClosestRayResultCallback cb(from, to);
-    world->rayTest(from, to, cb);
-    if(cb.m_collisionObject)
-        return std::optional<intersection>({
-            bt_to_glm(cb.m_hitPointWorld),
-            bt_to_glm(cb.m_hitNormalWorld),
-            (entity)cb.m_collisionObject->getUserIndex(),
-            (entity)cb.m_collisionObject->getUserIndex2()
-        });
-    else return std::optional<intersection>();
+    return ray_test_closest_hit(world.get(), r, max_distance);
+}
+
+std::vector<std::optional<intersection>> collision_system::cast_rays_closest_hit(
+    argvec<ray> rays,
+    float max_distance
+) const
+{
+    return ray_test_closest_hits(*pool, world.get(), rays, max_distance);
 }
 
 std::vector<intersection> collision_system::cast_ray_all_hits(
@@ -117,31 +98,51 @@ void collision_system::refresh_all()
         refresh_collider(t, nullptr, impl);
     });
 
-    // Skeleton colliders
+    // Skeleton colliders. The world is only modified in this serial pass, the
+    // joint transforms are then refreshed in parallel across skeletons.
+    std::vector<std::tuple<transformable*, skeleton*, skeleton_collider*>> skeletons;
     s->foreach([&](entity id, transformable* t, skeleton& skel, skeleton_collider& c){
         vec3 scaling = t->get_global_scaling();
         if(scaling != c.get_current_scale())
             c.apply_scale(scaling);
 
-        for(size_t i = 0; i < c.joints.size(); ++i)
+        for(joint_collider& jc: c.joints)
         {
-            joint_collider& jc = c.joints[i];
-            if(!jc.col.valid())
-                continue;
-
-            transformable* jt = &skel.get_joint(i).node;
-            collider::impl_data* impl = jc.col.get_internal();
-            mat4 transform = jt->get_global_transform();
-            refresh_collider(t, &transform, impl);
+            if(jc.col.valid())
+                refresh_collider_shape(jc.col.get_internal());
+        }
+        skel.update_root_parent_transforms();
+        skeletons.emplace_back(t, &skel, &c);
+    });
+
+    parallel_chunks(*pool, skeletons.size(), 8, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; ++i)
+        {
+            auto [t, skel, c] = skeletons[i];
+            for(size_t j = 0; j < c->joints.size(); ++j)
+            {
+                joint_collider& jc = c->joints[j];
+                if(!jc.col.valid())
+                    continue;
+
+                transformable* jt = &skel->get_joint(j).node;
+                refresh_collider_transform(t, jt, jc.col.get_internal());
+            }
         }
     });
 }
 
 void collision_system::refresh_collider(
     transformable* base_transform,
-    mat4* local_transform,
+    transformable* local_transform,
     collider::impl_data* impl
 ){
+    refresh_collider_shape(impl);
+    refresh_collider_transform(base_transform, local_transform, impl);
+}
+
+void collision_system::refresh_collider_shape(collider::impl_data* impl)
+{
     if(impl->need_refresh)
     {
         world->removeCollisionObject(&impl->body);
@@ -149,17 +150,24 @@ void collision_system::refresh_collider(
         world->addCollisionObject(&impl->body, impl->category_flags, impl->category_mask);
         impl->need_refresh = false;
     }
+}
 
-    // Only update if the transform has changed since the last time.
-    uintptr_t revision = (uintptr_t)base_transform->update_cached_transform();
+void collision_system::refresh_collider_transform(
+    transformable* base_transform,
+    transformable* local_transform,
+    collider::impl_data* impl
+){
+    // Only update if the transform has changed since the last time. Static
+    // transformables never change revision, so they're skipped here too.
+    uintptr_t revision = combined_revision(base_transform, local_transform);
     bool outdated = (uintptr_t)impl->motion_state.m_userPointer != revision;
-    if(base_transform && (outdated || local_transform))
+    if(base_transform && outdated)
     {
         impl->motion_state.m_userPointer = (void*)revision;
 
         mat4 transform = base_transform->get_global_transform();
         if(local_transform)
-            transform = transform * (*local_transform);
+            transform = transform * local_transform->get_global_transform();
 
         vec3 translation, scaling;
         quat orientation;
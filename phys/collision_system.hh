@@ -44,7 +44,8 @@ public:
     collision_system(context& ctx, scene& s, options opt);
     ~collision_system();
 
-    // Sends 'collision' as events to the ECS and refreshes ray cast state
+    // Sends 'collision' and 'collision_batch' as events to the ECS and
+    // refreshes ray cast state
     void run();
 
     std::optional<intersection> cast_ray_closest_hit(
@@ -57,6 +58,13 @@ public:
         float max_distance = 1000.0f
     ) const;
 
+    // Same as cast_ray_closest_hit(), but for many rays at once. The rays are
+    // split across the thread pool of the context.
+    std::vector<std::optional<intersection>> cast_rays_closest_hit(
+        argvec<ray> rays,
+        float max_distance = 1000.0f
+    ) const;
+
     void set_debug_drawer(btIDebugDraw* drawer);
     void debug_draw();
 
@@ -77,15 +85,26 @@ private:
     void refresh_all();
     void refresh_collider(
         transformable* base_transform,
-        mat4* local_transform,
+        transformable* local_transform,
+        collider::impl_data* impl
+    );
+    void refresh_collider_shape(collider::impl_data* impl);
+    // Does not modify the world, so this can be called from multiple threads
+    // for different colliders.
+    static void refresh_collider_transform(
+        transformable* base_transform,
+        transformable* local_transform,
         collider::impl_data* impl
     );
 
+    thread_pool* pool;
     scene* s;
     std::unique_ptr<btCollisionConfiguration> collision_configuration;
     std::unique_ptr<btCollisionDispatcher> dispatcher;
     std::unique_ptr<btBroadphaseInterface> pair_cache;
     std::unique_ptr<btCollisionWorld> world;
+    std::vector<collision> step_contacts;
+    std::vector<collision_pair> step_pairs;
 };
 
 }
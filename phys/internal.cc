@@ -7,6 +7,12 @@
 #include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
 #include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
 #include "core/math.hh"
+#include "core/argvec.hh"
+#include "core/transformable.hh"
+#include "core/thread_pool.hh"
+#include "core/stack_allocator.hh"
+#include "collision.hh"
+#include <optional>
 
 namespace rb::phys
 {
@@ -40,6 +46,129 @@ inline btTransform glm_to_bt(mat4 m)
     return btTransform(glm_to_bt(orientation), glm_to_bt(translation));
 }
 
+// Calls f(begin, end) for consecutive chunks of [0, count), spread across the
+// thread pool. Returns once all chunks are done.
+template<typename F>
+void parallel_chunks(thread_pool& pool, size_t count, size_t chunk_size, F&& f)
+{
+    size_t task_count = (count + chunk_size - 1) / chunk_size;
+    if(task_count <= 1)
+    {
+        if(count > 0) f(size_t(0), count);
+        return;
+    }
+
+    auto funcs = stack_allocate<std::function<void()>>(task_count);
+    for(size_t i = 0; i < task_count; ++i)
+    {
+        funcs[i] = [&, i=i](){
+            f(i * chunk_size, rb::min((i+1) * chunk_size, count));
+        };
+    }
+    pool.add_tasks(funcs).wait();
+}
+
+// Colliders remember the revision of the transform they were last refreshed
+// with. For joint colliders, both the base and joint transforms count.
+inline uintptr_t combined_revision(
+    const transformable* base_transform,
+    const transformable* local_transform
+){
+    uintptr_t revision = base_transform ? base_transform->update_cached_transform() : 0;
+    if(local_transform)
+        revision = (revision << 16) | local_transform->update_cached_transform();
+    return revision;
+}
+
+// Gathers all contact points of the last step and emits them both as
+// individual collision events and as one collision_batch, but only to the
+// extent that someone is listening.
+inline void emit_collisions(
+    scene& s,
+    btDispatcher* dispatcher,
+    std::vector<collision>& contacts,
+    std::vector<collision_pair>& pairs
+){
+    bool emit_single = s.get_handler_count<collision>() != 0;
+    bool emit_batch = s.get_handler_count<collision_batch>() != 0;
+    if(!emit_single && !emit_batch)
+        return;
+
+    contacts.clear();
+    pairs.clear();
+    int num = dispatcher->getNumManifolds();
+    for(int i = 0; i < num; ++i)
+    {
+        btPersistentManifold* man = dispatcher->getManifoldByIndexInternal(i);
+        const btCollisionObject* o0 = man->getBody0();
+        const btCollisionObject* o1 = man->getBody1();
+        int count = man->getNumContacts();
+        if(count == 0)
+            continue;
+
+        pairs.push_back({
+            {(entity)o0->getUserIndex(), (entity)o1->getUserIndex()},
+            {(unsigned)o0->getUserIndex2(), (unsigned)o1->getUserIndex2()},
+            (uint32_t)contacts.size(),
+            (uint32_t)count
+        });
+        for(int j = 0; j < count; ++j)
+        {
+            const btManifoldPoint& point = man->getContactPoint(j);
+            contacts.push_back({
+                {(entity)o0->getUserIndex(), (entity)o1->getUserIndex()},
+                {(unsigned)o0->getUserIndex2(), (unsigned)o1->getUserIndex2()},
+                {bt_to_glm(point.getPositionWorldOnA()), bt_to_glm(point.getPositionWorldOnB())},
+                {bt_to_glm(point.m_localPointA), bt_to_glm(point.m_localPointB)}
+            });
+        }
+    }
+
+    if(emit_single)
+    {
+        for(const collision& c: contacts)
+            s.emit(c);
+    }
+
+    if(emit_batch)
+        s.emit(collision_batch{&contacts, &pairs});
+}
+
+inline std::optional<intersection> ray_test_closest_hit(
+    const btCollisionWorld* world,
+    const ray& r,
+    float max_distance
+){
+    btVector3 from = glm_to_bt(r.o);
+    btVector3 to = glm_to_bt(r.o+normalize(r.dir)*max_distance);
+    btCollisionWorld::ClosestRayResultCallback cb(from, to);
+    world->rayTest(from, to, cb);
+    if(cb.m_collisionObject)
+        return std::optional<intersection>({
+            bt_to_glm(cb.m_hitPointWorld),
+            bt_to_glm(cb.m_hitNormalWorld),
+            (entity)cb.m_collisionObject->getUserIndex(),
+            (entity)cb.m_collisionObject->getUserIndex2()
+        });
+    else return std::optional<intersection>();
+}
+
+// Ray tests only read the world, so batches of them can be split across
+// threads as long as nothing modifies the world in the meantime.
+inline std::vector<std::optional<intersection>> ray_test_closest_hits(
+    thread_pool& pool,
+    const btCollisionWorld* world,
+    argvec<ray> rays,
+    float max_distance
+){
+    std::vector<std::optional<intersection>> res(rays.size());
+    parallel_chunks(pool, rays.size(), 256, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; ++i)
+            res[i] = ray_test_closest_hit(world, rays[i], max_distance);
+    });
+    return res;
+}
+
 }
 
 #endif
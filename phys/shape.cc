@@ -92,8 +92,18 @@ shape::cone::cone(const aabb& bounding_box):
     height(bounding_box.max.y-bounding_box.min.y)
 {}
 
+// Prepended to serialized BVHs, which are only valid for the same build of
+// Bullet.
+struct bvh_data_header
+{
+    uint32_t bullet_version = BT_BULLET_VERSION;
+    uint32_t scalar_size = sizeof(btScalar);
+};
+
 struct shape::impl_data
 {
+    // A deserialized BVH lives in this buffer, so it must outlive 'shape'.
+    btAlignedObjectArray<unsigned char> bvh_buffer;
     std::unique_ptr<btCollisionShape> shape;
     std::unique_ptr<tri_vertex_data> vertex_data;
 };
@@ -192,7 +202,33 @@ shape::shape(context& ctx, static_mesh&& c, const params& p)
             data->vertex_data.reset(
                 new tri_vertex_data(std::move(c.indices), std::move(c.points))
             );
-            btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(&data->vertex_data->tri, true);
+            btOptimizedBvh* bvh = nullptr;
+            bvh_data_header header;
+            if(c.bvh_data.size() > sizeof(header))
+            {
+                memcpy(&header, c.bvh_data.data(), sizeof(header));
+                if(
+                    header.bullet_version == BT_BULLET_VERSION &&
+                    header.scalar_size == sizeof(btScalar)
+                ){
+                    // Deserialization happens in-place, in a 16-byte aligned
+                    // buffer.
+                    size_t size = c.bvh_data.size() - sizeof(header);
+                    data->bvh_buffer.resize(size);
+                    memcpy(
+                        &data->bvh_buffer[0],
+                        c.bvh_data.data() + sizeof(header),
+                        size
+                    );
+                    bvh = btOptimizedBvh::deSerializeInPlace(
+                        &data->bvh_buffer[0], size, false
+                    );
+                }
+            }
+            btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(
+                &data->vertex_data->tri, true, bvh == nullptr
+            );
+            if(bvh) shape->setOptimizedBvh(bvh);
             data->shape.reset(shape);
 
             set_shape_params(data->shape.get(), p);
@@ -273,6 +309,25 @@ btCollisionShape* shape::get_bt_shape() const
     return data->shape.get();
 }
 
+std::vector<uint8_t> shape::get_bvh_data() const
+{
+    auto* s = dynamic_cast<btBvhTriangleMeshShape*>(get_bt_shape());
+    if(!s || !s->getOptimizedBvh())
+        return {};
+
+    btOptimizedBvh* bvh = s->getOptimizedBvh();
+    btAlignedObjectArray<unsigned char> buffer;
+    buffer.resize(bvh->calculateSerializeBufferSize());
+    if(!bvh->serializeInPlace(&buffer[0], buffer.size(), false))
+        return {};
+
+    bvh_data_header header;
+    std::vector<uint8_t> out(sizeof(header) + buffer.size());
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), &buffer[0], buffer.size());
+    return out;
+}
+
 void shape::reset(const params& p)
 {
     btCollisionShape* s = get_bt_shape();
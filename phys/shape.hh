@@ -79,6 +79,9 @@ public:
     {
         std::vector<uint32_t> indices;
         std::vector<vec3> points;
+        // Optional, from get_bvh_data() of a shape with the same mesh. Skips
+        // building the BVH, which is the slow part of creating the shape.
+        std::vector<uint8_t> bvh_data;
     };
 
     shape(context& ctx, box&& c, const params& p);
@@ -102,6 +105,11 @@ public:
     btCollisionShape* get_bt_shape() const;
     void reset(const params& p);
 
+    // Returns the BVH of a static_mesh shape serialized for
+    // static_mesh::bvh_data, or nothing for other shapes. Data serialized by
+    // a different version of Bullet is ignored when loading.
+    std::vector<uint8_t> get_bvh_data() const;
+
     // Can be dangerous, calls reset().
     void apply_scale(vec3 scaling);
     vec3 get_scaling() const;
@@ -121,18 +121,16 @@ std::optional<intersection> simulator::cast_ray_closest_hit(
 ){
     std::unique_lock lk(async_mutex);
     finish_update();
-    btVector3 from = glm_to_bt(r.o);
-    btVector3 to = glm_to_bt(r.o+normalize(r.dir)*max_distance);
-    btCollisionWorld::ClosestRayResultCallback cb(from, to);
-    world->rayTest(from, to, cb);
-    if(cb.m_collisionObject)
-        return std::optional<intersection>({
-            bt_to_glm(cb.m_hitPointWorld),
-            bt_to_glm(cb.m_hitNormalWorld),
-            (entity)cb.m_collisionObject->getUserIndex(),
-            (entity)cb.m_collisionObject->getUserIndex2()
-        });
-    else return std::optional<intersection>();
+    return ray_test_closest_hit(world.get(), r, max_distance);
+}
+
+std::vector<std::optional<intersection>> simulator::cast_rays_closest_hit(
+    argvec<ray> rays,
+    float max_distance
+){
+    std::unique_lock lk(async_mutex);
+    finish_update();
+    return ray_test_closest_hits(*pool, world.get(), rays, max_distance);
 }
 
 std::vector<intersection> simulator::cast_ray_all_hits(
@@ -336,23 +334,7 @@ void simulator::post_update_impl()
 {
     world_to_scene_state();
 
-    int num = dispatcher->getNumManifolds();
-    for(int i = 0; i < num; ++i)
-    {
-        btPersistentManifold* man = dispatcher->getManifoldByIndexInternal(i);
-        const btCollisionObject* o0 = man->getBody0();
-        const btCollisionObject* o1 = man->getBody1();
-        for(int j = 0; j < man->getNumContacts(); ++j)
-        {
-            const btManifoldPoint& point = man->getContactPoint(j);
-            s->emit(collision{
-                {(entity)o0->getUserIndex(), (entity)o1->getUserIndex()},
-                {(entity)o0->getUserIndex2(), (entity)o1->getUserIndex2()},
-                {bt_to_glm(point.getPositionWorldOnA()), bt_to_glm(point.getPositionWorldOnB())},
-                {bt_to_glm(point.m_localPointA), bt_to_glm(point.m_localPointB)}
-            });
-        }
-    }
+    emit_collisions(*s, dispatcher.get(), step_contacts, step_pairs);
 }
 
 void simulator::step_simulation(time_ticks delta_time)
@@ -373,20 +355,36 @@ void simulator::scene_state_to_world()
         refresh_collider(t, nullptr, c);
     });
 
+    // The world is only modified in this serial pass, the joint transforms
+    // are then refreshed in parallel across skeletons.
+    std::vector<std::tuple<transformable*, skeleton*, skeleton_collider*>> skeletons;
     s->foreach([&](entity id, transformable* t, skeleton& skel, skeleton_collider& c){
         vec3 scaling = t->get_global_scaling();
         if(scaling != c.get_current_scale())
             c.apply_scale(scaling);
 
-        for(size_t i = 0; i < c.joints.size(); ++i)
+        for(joint_collider& jc: c.joints)
         {
-            joint_collider& jc = c.joints[i];
-            if(!jc.col.valid())
-                continue;
+            if(jc.col.valid())
+                refresh_collider_shape(jc.col);
+        }
+        skel.update_root_parent_transforms();
+        skeletons.emplace_back(t, &skel, &c);
+    });
+
+    parallel_chunks(*pool, skeletons.size(), 8, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; ++i)
+        {
+            auto [t, skel, c] = skeletons[i];
+            for(size_t j = 0; j < c->joints.size(); ++j)
+            {
+                joint_collider& jc = c->joints[j];
+                if(!jc.col.valid())
+                    continue;
 
-            transformable* jt = &skel.get_joint(i).node;
-            mat4 transform = jt->get_global_transform();
-            refresh_collider(t, &transform, jc.col);
+                transformable* jt = &skel->get_joint(j).node;
+                refresh_collider_transform(t, jt, jc.col);
+            }
         }
     });
 }
@@ -471,9 +469,15 @@ void simulator::add_collider(
 
 void simulator::refresh_collider(
     transformable* base_transform,
-    mat4* local_transform,
+    transformable* local_transform,
     collider& c
 ){
+    refresh_collider_shape(c);
+    refresh_collider_transform(base_transform, local_transform, c);
+}
+
+void simulator::refresh_collider_shape(collider& c)
+{
     collider::impl_data* impl = c.get_internal();
     if(impl->need_refresh)
     {
@@ -482,19 +486,28 @@ void simulator::refresh_collider(
         world->addRigidBody(&impl->body, impl->category_flags, impl->category_mask);
         impl->need_refresh = false;
     }
+}
 
+void simulator::refresh_collider_transform(
+    transformable* base_transform,
+    transformable* local_transform,
+    collider& c
+){
+    collider::impl_data* impl = c.get_internal();
     // Only update kinematics if the transform has changed since the last time.
-    uintptr_t revision = (uintptr_t)base_transform->update_cached_transform();
+    // Static transformables never change revision, so they're skipped here
+    // too.
+    uintptr_t revision = combined_revision(base_transform, local_transform);
     bool outdated = (uintptr_t)impl->motion_state.m_userPointer != revision;
     if(
         base_transform && (c.get_category_flags() & (collider::KINEMATIC|collider::STATIC)) &&
-        (outdated || local_transform)
+        outdated
     ){
         impl->motion_state.m_userPointer = (void*)revision;
 
         mat4 transform = base_transform->get_global_transform();
         if(local_transform)
-            transform = transform * (*local_transform);
+            transform = transform * local_transform->get_global_transform();
 
         vec3 translation, scaling;
         quat orientation;
@@ -79,6 +79,12 @@ public:
         float max_distance
     );
 
+    // Batched closest hit queries, split across the thread pool.
+    std::vector<std::optional<intersection>> cast_rays_closest_hit(
+        argvec<ray> rays,
+        float max_distance
+    );
+
     // Don't call these directly yourself, they're called automatically by
     // phys_debug_draw_stage.
     void set_debug_drawer(btIDebugDraw* drawer);
@@ -108,7 +114,15 @@ private:
     );
     void refresh_collider(
         transformable* base_transform,
-        mat4* local_transform,
+        transformable* local_transform,
+        collider& c
+    );
+    void refresh_collider_shape(collider& c);
+    // Does not modify the world, so this can be called from multiple threads
+    // for different colliders.
+    static void refresh_collider_transform(
+        transformable* base_transform,
+        transformable* local_transform,
         collider& c
     );
 
@@ -124,6 +138,8 @@ private:
     std::unique_ptr<btConstraintSolver> constraint_solver;
     std::unique_ptr<btConstraintSolverPoolMt> constraint_solver_pool;
     std::unique_ptr<btDiscreteDynamicsWorld> world;
+    std::vector<collision> step_contacts;
+    std::vector<collision_pair> step_pairs;
 };
 
 }